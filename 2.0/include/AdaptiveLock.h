@@ -0,0 +1,45 @@
+#pragma once
+#include "./Common.h"
+namespace Memory_Pool
+{
+    // 自适应锁：无竞争时一次CAS加锁；有竞争时先短暂自旋，仍拿不到则在futex上休眠
+    // 状态：0-未加锁，1-已加锁，2-已加锁且可能有线程休眠等待
+    // 独占一个缓存行，避免相邻的锁之间伪共享
+    class alignas(CACHE_LINE_SIZE) AdaptiveLock
+    {
+    public:
+        void lock()
+        {
+            uint32_t expected = 0;
+            if (MEMORY_POOL_LIKELY(state.compare_exchange_strong(expected, 1, std::memory_order_acquire,
+                                                                 std::memory_order_relaxed)))
+            {
+                return;
+            }
+            lockSlow();
+        }
+
+        void unlock()
+        {
+            // 有线程休眠时才需要系统调用唤醒
+            if (MEMORY_POOL_UNLIKELY(state.exchange(0, std::memory_order_release) == 2))
+            {
+                wake();
+            }
+        }
+
+        // 竞争统计：发生等待的次数和累计等待时间
+        uint64_t waitCount() const { return waits.load(std::memory_order_relaxed); }
+        uint64_t waitNanos() const { return waitTime.load(std::memory_order_relaxed); }
+
+    private:
+        MEMORY_POOL_COLD void lockSlow();
+        void wake();
+
+    private:
+        std::atomic<uint32_t> state{0};
+        // 统计值只在持有锁时写入，读取可以不加锁
+        std::atomic<uint64_t> waits{0};
+        std::atomic<uint64_t> waitTime{0};
+    };
+}
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "./Common.h"
+#include "./AdaptiveLock.h"
+#include <iosfwd>
 
 namespace Memory_Pool
 {
+    struct Span;
+
     class CentralCache
     {
     public:
@@ -12,28 +16,87 @@ namespace Memory_Pool
             static CentralCache instance;
             return instance;
         }
-        void *fetchRange(size_t index, size_t batchnum);
-        void returnRange(void *ptr, size_t index, size_t batchnum);
+        // 获取最多batchNum个内存块，通过start/end返回链表首尾，返回实际获取的块数
+        size_t fetchRange(void *&start, void *&end, size_t index, size_t batchNum);
+        // 归还以start开头、end结尾的batchNum个内存块
+        void returnRange(void *start, void *end, size_t index, size_t batchNum);
+
+        // 将所有分片中转缓存中的批次放回所属span，完全空闲的span归还页缓存
+        void flushTransferCaches();
+
+        // 输出各大小类的span占用、尾部浪费和锁竞争统计
+        void printStats(std::ostream &os) const;
 
     private:
-        CentralCache()
-        {   
-            for(auto &ptr:central_free_list)
-            {
-                ptr.store(nullptr, std::memory_order_relaxed);
-            }
-            for(auto &lock:locks){
-                lock.clear();
-            }
-        }
+        CentralCache();
+
+        // 从页缓存获取一个span并切分成index大小类的小对象
+        Span *fetchFromPageCache(size_t index);
+        // 从node节点index大小类的span中取出最多batchNum个小对象，调用方需持有锁
+        size_t fetchFromSpans(void *&start, void *&end, size_t index, size_t batchNum, size_t node);
+        // 将链表中的小对象逐个放回所属span，完全空闲的span放入releaseList，调用方需持有锁
+        void releaseToSpans(void *start, size_t index, Span *&releaseList);
+        // 将完全空闲的span归还页缓存，调用方不能持有锁
+        void releaseSpans(Span *releaseList);
+        // 按span的占用率将其放入所属节点的对应分组，没有空闲对象的span不在任何分组中
+        void linkSpan(Span *span, size_t index);
+        void unlinkSpan(Span *span, size_t index);
+        // 加锁和解锁
+        void lock(size_t index);
+        void unlock(size_t index);
+
+    private:
+        // 一个完整批次：首尾指针已知，整批移动只需O(1)
+        struct Batch
+        {
+            void *head;
+            void *tail;
+            size_t count;
+        };
+        // 中转缓存，保存线程间整批流转的内存块，每个分片每个大小类一个，各自加锁
+        struct alignas(CACHE_LINE_SIZE) TransferCache
+        {
+            AdaptiveLock lock;
+            std::atomic<size_t> used{0}; // 已使用的槽数，只在持有锁时修改，可以不加锁读取
+            std::array<Batch, TRANSFER_CACHE_SLOTS> slots;
+        };
 
-        // 从页缓存获取内存
-        void *fetchFromPageCache(size_t size);
+        // 当前CPU所在的分片
+        size_t currentShard() const;
+        TransferCache &transferCache(size_t shard, size_t index)
+        {
+            return transfer_cache[shard * FREE_LIST_SIZE + index];
+        }
+        // 从本地分片取出一个完整批次，本地为空时依次从同一节点的其他分片窃取
+        bool popBatch(size_t index, Batch &batch);
+        // 从指定的中转缓存取出一个完整批次
+        static bool takeBatch(TransferCache &transfer, Batch &batch);
+        // 将完整批次放入本地分片，分片已满返回false
+        // 多节点时按批次首个对象所属span的节点放入该节点的分片，其他节点释放的内存不会交给本节点的线程
+        bool pushBatch(size_t index, const Batch &batch);
 
     private:
-        // 中心缓存的自由链表
-        std::array<std::atomic<void *>, FREE_LIST_SIZE> central_free_list;
-        // 用于同步的自旋锁
-        std::array<std::atomic_flag, FREE_LIST_SIZE> locks;
+        // 中转缓存按NUMA节点和节点内的CPU分组分片，同组CPU共享一个分片，减少对同一把锁的竞争
+        // 同一节点的分片连续存放，窃取不跨节点，批次只在同一节点的CPU之间流转
+        TransferCache *transfer_cache; // numShards * FREE_LIST_SIZE个中转缓存
+        size_t numShards;
+        size_t numNodes;
+        size_t shardsPerNode;
+
+        // 每个节点每个大小类中仍有空闲对象的span，按占用率分组，优先从占用率最高的分组分配
+        // 让占用率低的span有机会完全空闲并归还页缓存
+        struct alignas(CACHE_LINE_SIZE) SpanLists
+        {
+            std::array<Span *, SPAN_BUCKETS> buckets{};
+            std::atomic<size_t> spanCount{0}; // 该节点该大小类持有的span总数，包括没有空闲对象的span，持有锁时修改
+        };
+        SpanLists *span_lists; // numNodes * FREE_LIST_SIZE个span分组，按span所属节点放入
+        SpanLists &spanLists(size_t node, size_t index) const
+        {
+            return span_lists[node * FREE_LIST_SIZE + index];
+        }
+
+        // 每个大小类一把自适应锁，保护该大小类所有节点的span分组
+        std::array<AdaptiveLock, FREE_LIST_SIZE> locks;
     };
-}
\ No newline at end of file
+}
@@ -1,16 +1,58 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <atomic>
 #include <array>
 
+// 分支预测提示与冷路径标记，让快速路径保持紧凑
+#if defined(__GNUC__)
+#define MEMORY_POOL_LIKELY(x) __builtin_expect(!!(x), 1)
+#define MEMORY_POOL_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#define MEMORY_POOL_COLD __attribute__((cold, noinline))
+#else
+#define MEMORY_POOL_LIKELY(x) (x)
+#define MEMORY_POOL_UNLIKELY(x) (x)
+#define MEMORY_POOL_COLD
+#endif
+
 namespace Memory_Pool
 {
     // 对齐数和大小定义
-    constexpr size_t ALIGNMENT = 8;                         // void*指针大小
-    constexpr size_t MAX_SIZE = 256 * 1024;                 // 256KB
-    constexpr size_t FREE_LIST_SIZE = MAX_SIZE / ALIGNMENT; // 最大槽位数
+    constexpr size_t ALIGNMENT = 8;         // void*指针大小
+    constexpr size_t MAX_SIZE = 256 * 1024; // 256KB
+    constexpr size_t CACHE_LINE_SIZE = 64;  // 缓存行大小
+    constexpr size_t PAGE_SHIFT = 12;
+    constexpr size_t PAGE_SIZE = size_t(1) << PAGE_SHIFT; // 页大小4KB
+    constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;    // 透明大页大小2MB
+    constexpr size_t HUGE_PAGE_PAGES = HUGE_PAGE_SIZE / PAGE_SIZE;
+    constexpr size_t MAX_NUMA_NODES = 64;                 // 页缓存最多为多少个NUMA节点建立独立页堆
+    constexpr size_t MAX_BUCKET_PAGES = 128;              // 页缓存按页数直接索引的空闲span上限，更大的按地址排序
+    constexpr size_t MAX_RELEASE_BATCH = 16;              // 延迟归还每次检查最多在锁外madvise的span数
+
+    // 线程缓存容量定义
+    constexpr size_t MAX_MOVE_BYTES = 64 * 1024;               // 单批次在线程缓存与中心缓存间移动的字节数
+    constexpr size_t MAX_MOVE_NUM = 64;                        // 单批次移动的最大块数
+    constexpr size_t MAX_LIST_BYTES = 1024 * 1024;             // 单个大小类链表最多缓存的字节数
+    constexpr size_t MAX_LIST_LENGTH = 8192;                   // 单个大小类链表最多缓存的块数
+    constexpr size_t MAX_THREAD_CACHE_BYTES = 4 * 1024 * 1024; // 单个线程缓存最多缓存的字节数
+    constexpr size_t MIN_THREAD_CACHE_BYTES = 512 * 1024;      // 预算充足时单个线程缓存的初始容量
+    constexpr size_t FLOOR_THREAD_CACHE_BYTES = 64 * 1024;     // 预算耗尽时新线程缓存的初始容量，窃取时不会低于该值
+    constexpr size_t STEAL_AMOUNT = 64 * 1024;                 // 每次扩容挪取的字节数
+    constexpr size_t DEFAULT_TOTAL_THREAD_CACHE_BYTES = 32 * 1024 * 1024; // 所有线程缓存的默认总预算
+    constexpr size_t MAX_CPU_CACHE_BYTES = 2 * 1024 * 1024;    // 每CPU缓存模式下每个CPU槽最多缓存的字节数
+    constexpr size_t MAX_CPU_TRIM_BATCHES = 16;                // 每次释放最多从CPU槽摘下归还的批次数
+
+    // 大对象缓存容量定义
+    constexpr size_t MAX_LARGE_CACHE_PAGES = 1024;             // 缓存的大对象最多4MB，更大的直接归还页缓存
+    constexpr size_t MAX_LARGE_CACHE_BYTES = 64 * 1024 * 1024; // 大对象缓存的总字节数上限
+
+    // 中心缓存容量定义
+    constexpr size_t TRANSFER_CACHE_SLOTS = 32; // 每个大小类中转缓存可保存的完整批次数
+    constexpr size_t SPAN_BUCKETS = 8;          // 按占用率划分的span分组数
+    constexpr size_t CPUS_PER_SHARD = 4;        // 共享同一组中转缓存的CPU数
+    constexpr size_t MAX_SPAN_WASTE_RATIO = 8;  // span尾部浪费不超过span大小的1/8（12.5%）
 
     // 内存块头部信息
     struct BlockHeader
@@ -20,23 +62,154 @@ namespace Memory_Pool
         BlockHeader *next; // 指向下一个内存块
     };
 
+    namespace detail
+    {
+        // 计算下一个大小类：128B以内按8B递增，
+        // 128B~8KB每翻一倍切分8档，8KB~256KB每翻一倍切分4档（内部碎片分别不超过12.5%和25%）
+        constexpr size_t nextClassSize(size_t size)
+        {
+            if (size < 128)
+            {
+                return size + ALIGNMENT;
+            }
+            size_t pow2 = 128;
+            while (pow2 * 2 <= size)
+            {
+                pow2 *= 2;
+            }
+            return size + pow2 / (size < 8 * 1024 ? 8 : 4);
+        }
+
+        // 大小类数量，0号保留不用，表示"非小对象"
+        constexpr size_t countClasses()
+        {
+            size_t num = 1;
+            for (size_t size = ALIGNMENT; size <= MAX_SIZE; size = nextClassSize(size))
+            {
+                num++;
+            }
+            return num;
+        }
+    }
+
+    constexpr size_t FREE_LIST_SIZE = detail::countClasses(); // 自由链表数（大小类数量）
+
+    namespace detail
+    {
+        constexpr size_t MAX_SMALL_SIZE = 1024;
+        constexpr size_t CLASS_ARRAY_SIZE = ((MAX_SIZE + 127 + (120 << 7)) >> 7) + 1;
+
+        // 1KB以内按8B粒度、1KB以上按128B粒度计算查表位置
+        constexpr size_t classArrayIndex(size_t bytes)
+        {
+            // 小于等于1KB：(bytes + 7) / 8，范围[0, 128]
+            // 大于1KB：(bytes + 127 + 120 * 128) / 128，范围[129, CLASS_ARRAY_SIZE)
+            return bytes <= MAX_SMALL_SIZE ? (bytes + 7) >> 3
+                                           : (bytes + 127 + (120 << 7)) >> 7;
+        }
+
+        struct SizeClassTable
+        {
+            std::array<uint32_t, FREE_LIST_SIZE> classSizes{};  // 大小类 -> 块大小
+            std::array<uint8_t, FREE_LIST_SIZE> numToMove{};    // 大小类 -> 单批次移动块数
+            std::array<uint8_t, FREE_LIST_SIZE> classPages{};   // 大小类 -> 每个span的页数
+            std::array<uint8_t, CLASS_ARRAY_SIZE> classArray{}; // 查表位置 -> 大小类
+        };
+
+        constexpr SizeClassTable buildSizeClassTable()
+        {
+            SizeClassTable table{};
+            size_t index = 1;
+            size_t next = 0; // classArray中下一个待填写的位置
+            for (size_t size = ALIGNMENT; size <= MAX_SIZE; size = nextClassSize(size), index++)
+            {
+                table.classSizes[index] = static_cast<uint32_t>(size);
+                // 每批次约移动MAX_MOVE_BYTES，至少2块以摊薄中心缓存的加锁开销
+                size_t num = MAX_MOVE_BYTES / size;
+                num = num < 2 ? 2 : (num > MAX_MOVE_NUM ? MAX_MOVE_NUM : num);
+                table.numToMove[index] = static_cast<uint8_t>(num);
+                // span至少容纳一个完整批次，再逐页增大直到尾部浪费不超过阈值
+                size_t pages = (num * size + PAGE_SIZE - 1) / PAGE_SIZE;
+                while ((pages * PAGE_SIZE) % size * MAX_SPAN_WASTE_RATIO > pages * PAGE_SIZE)
+                {
+                    pages++;
+                }
+                table.classPages[index] = static_cast<uint8_t>(pages);
+                size_t last = classArrayIndex(size);
+                for (; next <= last; next++)
+                {
+                    table.classArray[next] = static_cast<uint8_t>(index);
+                }
+            }
+            return table;
+        }
+
+        inline constexpr SizeClassTable SIZE_CLASS_TABLE = buildSizeClassTable();
+    }
+
+    // 大小类映射表：参考tcmalloc，编译期生成，运行时只需一次查表
     class SizeClass
     {
     public:
-        static size_t roundup(size_t bytes)
+        // 将bytes映射为大小类索引（bytes需不超过MAX_SIZE，0按最小类处理）
+        static constexpr size_t getIndex(size_t bytes)
+        {
+            return detail::SIZE_CLASS_TABLE.classArray[detail::classArrayIndex(bytes)];
+        }
+        // 大小类对应的内存块大小
+        static constexpr size_t classSize(size_t index)
+        {
+            return detail::SIZE_CLASS_TABLE.classSizes[index];
+        }
+        // 线程缓存与中心缓存之间单批次移动的块数
+        static constexpr size_t numToMove(size_t index)
+        {
+            return detail::SIZE_CLASS_TABLE.numToMove[index];
+        }
+        // 中心缓存为该大小类向页缓存申请的span页数
+        static constexpr size_t classPages(size_t index)
         {
-            // bytes加上ALIGNMENT-1确保向上取整
-            //~(ALIGNMENT - 1)创建了一个高位掩码
-            // 通过与操作，清除多余的低位
-            return (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+            return detail::SIZE_CLASS_TABLE.classPages[index];
         }
-        static size_t getIndex(size_t bytes)
+        // 每个span切分出的块数
+        static constexpr size_t objectsPerSpan(size_t index)
         {
-            // 确保bytes至少为ALIGNMENT
-            bytes = std::max(bytes, ALIGNMENT);
-            // 向上取整后-1
-            return (bytes + ALIGNMENT - 1) / ALIGNMENT - 1;
+            return classPages(index) * PAGE_SIZE / classSize(index);
+        }
+        // 每个span尾部无法切分的字节数
+        static constexpr size_t spanWaste(size_t index)
+        {
+            return classPages(index) * PAGE_SIZE % classSize(index);
+        }
+        // 向上取整到所属大小类的块大小
+        static constexpr size_t roundup(size_t bytes)
+        {
+            return classSize(getIndex(bytes));
         }
     };
 
-}
\ No newline at end of file
+    static_assert(FREE_LIST_SIZE <= 256, "大小类索引需能用uint8_t表示");
+    static_assert(SizeClass::roundup(0) == ALIGNMENT && SizeClass::roundup(1) == ALIGNMENT);
+    static_assert(SizeClass::roundup(MAX_SIZE) == MAX_SIZE);
+
+    namespace detail
+    {
+        // 检查每个大小类的span都满足浪费上限且至少容纳一个完整批次
+        constexpr bool checkSpanPages()
+        {
+            for (size_t index = 1; index < FREE_LIST_SIZE; index++)
+            {
+                size_t spanBytes = SizeClass::classPages(index) * PAGE_SIZE;
+                if (SizeClass::classPages(index) == 0 ||
+                    SizeClass::spanWaste(index) * MAX_SPAN_WASTE_RATIO > spanBytes ||
+                    SizeClass::objectsPerSpan(index) < SizeClass::numToMove(index))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+    static_assert(detail::checkSpanPages(), "span页数需满足浪费上限并至少容纳一个完整批次");
+
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "./Common.h"
+#include "./AdaptiveLock.h"
+namespace Memory_Pool
+{
+    // 按CPU划分的前端缓存，缓存数量随核数而非线程数增长
+    // 通过Linux rseq读取当前CPU编号；线程可能在读取后被迁移，因此每个CPU的缓存仍由一把几乎无竞争的自适应锁保护
+    // 槽锁只保护链表操作，与中心缓存之间的批次移动都在释放槽锁之后进行
+    class CpuCache
+    {
+    public:
+        static CpuCache &getInstance()
+        {
+            static CpuCache instance;
+            return instance;
+        }
+        // 当前系统是否支持rseq，不支持时调用方应回退到线程缓存
+        static bool isAvailable();
+
+        void *allocate(size_t size);
+        void deallocate(void *ptr, size_t size);
+
+        // 槽数量，即配置的CPU数
+        size_t slotCount() const { return numCpus; }
+        // 指定CPU槽当前缓存的字节数
+        size_t cachedBytes(size_t cpu);
+
+    private:
+        CpuCache();
+
+        struct FreeList
+        {
+            void *head = nullptr; // 链表头
+            uint32_t length = 0;  // 链表长度
+        };
+        // 每个CPU一个槽，按缓存行对齐避免伪共享
+        struct alignas(CACHE_LINE_SIZE) CpuSlot
+        {
+            AdaptiveLock lock;     // 保护本槽，持有者被抢占时等待者在futex上休眠而不是空转
+            size_t cacheSize = 0;  // 本槽缓存的总字节数
+            size_t trimCursor = 0; // 超限时下一次从哪个大小类开始回收
+            std::array<FreeList, FREE_LIST_SIZE> free_list;
+        };
+        // 从链表上摘下、等待在锁外归还中心缓存的一批内存块
+        struct Batch
+        {
+            void *start;
+            void *end;
+            size_t count;
+            size_t index;
+        };
+
+        // 获取当前CPU对应的槽并加锁
+        CpuSlot &lockCurrentSlot();
+        // 在锁外从中心缓存获取一批内存块，返回其中一个，其余放入当前CPU的链表
+        void *fetchFromCentralCache(size_t index);
+        // 从链表头部摘下最多num个内存块，调用方需持有槽锁
+        Batch detachBatch(CpuSlot &slot, size_t index, size_t num);
+        // 释放槽锁前摘下超出的批次：链表超过两个批次时摘下一批，槽超过字节上限时从各大小类轮流摘下，
+        // 最多摘下count个批次，返回摘下的批次数
+        size_t collectOverflow(CpuSlot &slot, size_t index, Batch *batches, size_t count);
+        // 摘下超出的批次后释放槽锁，在锁外归还中心缓存；一轮之后仍超过字节上限时重新加锁继续回收
+        void unlockAndTrim(CpuSlot &slot, size_t index);
+
+    private:
+        CpuSlot *slots;  // 按CPU编号索引的槽数组
+        size_t numCpus;  // 槽数量
+    };
+}
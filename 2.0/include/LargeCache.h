@@ -0,0 +1,48 @@
+#pragma once
+#include "./Common.h"
+#include <mutex>
+#include <iosfwd>
+namespace Memory_Pool
+{
+    struct Span;
+
+    // 大对象缓存：超过MAX_SIZE的对象以整个span的形式从页缓存分配，页数记录在span中，释放时无需大小
+    // 最近释放的span按页数缓存，相同页数的请求直接复用，避免反复经过页缓存的分割与合并
+    class LargeCache
+    {
+    public:
+        static LargeCache &getInstance()
+        {
+            static LargeCache instance;
+            return instance;
+        }
+
+        // 分配至少size字节的大对象，zeroed为true时保证内容全为0
+        void *allocate(size_t size, bool zeroed = false);
+        // 释放大对象，不是大对象的地址直接忽略
+        void deallocate(void *ptr);
+        // 将缓存的span全部归还页缓存
+        void flush();
+
+        void printStats(std::ostream &os);
+
+    private:
+        LargeCache() = default;
+
+        // 从页数桶和LRU链表中摘除span，调用方需持有锁
+        void unlink(Span *span);
+        // 将span链表逐个归还页缓存，调用方不能持有锁
+        static void releaseSpans(Span *list);
+
+    private:
+        // 按页数索引的桶，通过Span::prev/next串成双向链表
+        std::array<Span *, MAX_LARGE_CACHE_PAGES + 1> buckets{};
+        // 所有缓存的span按释放时间通过Span::dirtyPrev/dirtyNext串成LRU链表，超出容量时从最旧的淘汰
+        Span *lruHead = nullptr; // 最新
+        Span *lruTail = nullptr; // 最旧
+        size_t cachedPages = 0;
+        size_t hits = 0;
+        size_t misses = 0;
+        std::mutex mtx;
+    };
+}
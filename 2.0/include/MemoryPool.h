@@ -1,5 +1,14 @@
 #pragma once
 #include "./ThreadCache.h"
+#include "./PageCache.h"
+#include "./CentralCache.h"
+#include "./LargeCache.h"
+#include <new>
+#include <utility>
+#include <cstring>
+#ifdef MEMORY_POOL_PER_CPU_CACHE
+#include "./CpuCache.h"
+#endif
 namespace Memory_Pool
 {
     class MemoryPool
@@ -7,12 +16,203 @@ namespace Memory_Pool
     public:
         static void *allocate(size_t size)
         {
+#ifdef MEMORY_POOL_PER_CPU_CACHE
+            // 每CPU缓存模式，rseq不可用时回退到线程缓存
+            if (CpuCache::isAvailable())
+            {
+                return CpuCache::getInstance().allocate(size);
+            }
+#endif
             return ThreadCache::getInstance()->allocate(size);
         }
         static void deallocate(void *ptr, size_t size)
         {
+#ifdef MEMORY_POOL_PER_CPU_CACHE
+            if (CpuCache::isAvailable())
+            {
+                CpuCache::getInstance().deallocate(ptr, size);
+                return;
+            }
+#endif
             ThreadCache::getInstance()->deallocate(ptr, size);
         }
+        // 分配内容全为0的内存，释放方式与allocate相同
+        static void *allocateZeroed(size_t size)
+        {
+            if (size > MAX_SIZE)
+            {
+                return ThreadCache::allocateLargeZeroed(size);
+            }
+            // 小对象来自复用的空闲链表，内容不确定，直接清零
+            void *ptr = allocate(size);
+            if (ptr != nullptr)
+            {
+                memset(ptr, 0, size);
+            }
+            return ptr;
+        }
+        // 编译期已知大小的分配：大小类、边界检查和大对象分支都在编译期确定
+        template <size_t Size>
+        static void *allocate()
+        {
+#ifdef MEMORY_POOL_PER_CPU_CACHE
+            if (CpuCache::isAvailable())
+            {
+                return CpuCache::getInstance().allocate(Size);
+            }
+#endif
+            if constexpr (Size > MAX_SIZE)
+            {
+                return ThreadCache::allocateLarge(Size);
+            }
+            else
+            {
+                constexpr size_t index = SizeClass::getIndex(Size);
+                return ThreadCache::getInstance()->allocateClass(index);
+            }
+        }
+        template <size_t Size>
+        static void deallocate(void *ptr)
+        {
+#ifdef MEMORY_POOL_PER_CPU_CACHE
+            if (CpuCache::isAvailable())
+            {
+                CpuCache::getInstance().deallocate(ptr, Size);
+                return;
+            }
+#endif
+            if constexpr (Size > MAX_SIZE)
+            {
+                ThreadCache::deallocateLarge(ptr);
+            }
+            else
+            {
+                constexpr size_t index = SizeClass::getIndex(Size);
+                ThreadCache::getInstance()->deallocateClass(ptr, index);
+            }
+        }
+
+        // 在内存池中构造T类型对象，分配失败返回nullptr
+        template <typename T, typename... Args>
+        static T *newObject(Args &&...args)
+        {
+            static_assert(alignof(T) <= ALIGNMENT, "内存池只保证ALIGNMENT字节对齐");
+            void *ptr = allocate<sizeof(T)>();
+            if (ptr == nullptr)
+            {
+                return nullptr;
+            }
+            try
+            {
+                return new (ptr) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                deallocate<sizeof(T)>(ptr);
+                throw; // 构造失败时归还内存后重新抛出
+            }
+        }
+        // 析构并释放newObject创建的对象
+        template <typename T>
+        static void deleteObject(T *ptr)
+        {
+            if (ptr)
+            {
+                ptr->~T();
+                deallocate<sizeof(T)>(static_cast<void *>(ptr));
+            }
+        }
+
+        // 批量分配num个size大小的内存块写入out，返回实际分配的块数
+        static size_t allocateBatch(size_t size, size_t num, void **out)
+        {
+#ifdef MEMORY_POOL_PER_CPU_CACHE
+            if (CpuCache::isAvailable())
+            {
+                for (size_t i = 0; i < num; i++)
+                {
+                    if ((out[i] = CpuCache::getInstance().allocate(size)) == nullptr)
+                    {
+                        return i;
+                    }
+                }
+                return num;
+            }
+#endif
+            return ThreadCache::getInstance()->allocateBatch(size, num, out);
+        }
+        // 批量释放num个size大小的内存块
+        static void deallocateBatch(void **ptrs, size_t num, size_t size)
+        {
+#ifdef MEMORY_POOL_PER_CPU_CACHE
+            if (CpuCache::isAvailable())
+            {
+                for (size_t i = 0; i < num; i++)
+                {
+                    CpuCache::getInstance().deallocate(ptrs[i], size);
+                }
+                return;
+            }
+#endif
+            ThreadCache::getInstance()->deallocateBatch(ptrs, num, size);
+        }
+        // 无需大小的释放：通过页映射查出所属大小类
+        static void deallocate(void *ptr)
+        {
+            if (ptr == nullptr)
+            {
+                return;
+            }
+            size_t index = PageCache::getInstance().getSizeClass(ptr);
+            if (index == 0)
+            {
+                ThreadCache::deallocateLarge(ptr); // 大对象的页数记录在span中
+                return;
+            }
+            deallocate(ptr, SizeClass::classSize(index));
+        }
+        // 输出内存池的统计信息
+        static void printStats(std::ostream &os)
+        {
+            CentralCache::getInstance().printStats(os);
+            LargeCache::getInstance().printStats(os);
+            PageCache::getInstance().printStats(os);
+        }
+        // 将中心缓存中转的批次、缓存的大对象和所有空闲页立即归还系统，适合在业务低峰期调用，返回归还的字节数
+        // 线程缓存中的对象不受影响
+        static size_t releaseFreeMemory()
+        {
+            CentralCache::getInstance().flushTransferCaches();
+            LargeCache::getInstance().flush();
+            return PageCache::getInstance().releaseFreeMemory();
+        }
+        // 开启或关闭透明大页模式，减少大堆上的TLB缺失
+        static void setHugePages(bool enable)
+        {
+            PageCache::getInstance().setHugePages(enable);
+        }
+        // 设置页缓存选择空闲span的策略，默认取最近释放的span，按地址排序可减少长时间运行后的碎片
+        static void setSpanPolicy(SpanPolicy policy)
+        {
+            PageCache::getInstance().setSpanPolicy(policy);
+        }
+        // 设置页缓存向系统预留地址空间的大小，默认1GB，用尽后按两倍增长
+        static void setReserveSize(size_t bytes)
+        {
+            PageCache::getInstance().setReserveSize(bytes);
+        }
+        // 设置空闲页自动归还系统的延迟，默认10秒，0表示释放后立即归还
+        // 超时的页在之后分配或释放页时分批归还，进程空闲时需调用releaseFreeMemory()
+        static void setReleaseDecay(std::chrono::milliseconds decay)
+        {
+            PageCache::getInstance().setReleaseDecay(decay);
+        }
+        // 设置所有线程缓存共享的总字节数预算，默认32MB
+        // 预算耗尽后每个线程缓存仍保留64KB下限，线程很多时总量可超出预算 线程数*64KB
+        static void setMaxTotalThreadCacheBytes(size_t bytes)
+        {
+            ThreadCache::setMaxTotalCacheSize(bytes);
+        }
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+#include "./Common.h"
+#include <new>
+#include <utility>
+namespace Memory_Pool
+{
+    // 直接通过mmap申请清零的元数据内存，按页向上取整，不经过malloc和全局new
+    void *metadataAlloc(size_t bytes);
+
+    // 在元数据内存上构造count个T，用于启动时一次性创建的内部数组
+    template <typename T>
+    T *metadataNewArray(size_t count)
+    {
+        T *array = static_cast<T *>(metadataAlloc(count * sizeof(T)));
+        if (array != nullptr)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                new (array + i) T();
+            }
+        }
+        return array;
+    }
+
+    // 定长元数据分配器，用于Span等频繁创建和销毁的内部结构
+    // 以大块为单位从metadataAlloc申请，对象紧密排列；释放的对象挂入空闲链表复用，内存不归还系统
+    // 不加锁，调用方需自行串行化（如PageCache的互斥锁）
+    template <typename T>
+    class MetadataArena
+    {
+        static_assert(sizeof(T) >= sizeof(void *), "对象需能容纳空闲链表指针");
+        static_assert(alignof(T) <= PAGE_SIZE, "对象对齐不能超过页大小");
+
+    public:
+        template <typename... Args>
+        T *allocate(Args &&...args)
+        {
+            void *ptr = freeList;
+            if (ptr != nullptr)
+            {
+                freeList = *reinterpret_cast<void **>(ptr);
+            }
+            else
+            {
+                if (remaining < OBJECT_SIZE)
+                {
+                    chunk = static_cast<char *>(metadataAlloc(CHUNK_SIZE));
+                    if (chunk == nullptr)
+                    {
+                        remaining = 0;
+                        return nullptr;
+                    }
+                    remaining = CHUNK_SIZE;
+                    reserved += CHUNK_SIZE;
+                }
+                ptr = chunk;
+                chunk += OBJECT_SIZE;
+                remaining -= OBJECT_SIZE;
+            }
+            inUse++;
+            return new (ptr) T(std::forward<Args>(args)...);
+        }
+
+        void deallocate(T *obj)
+        {
+            obj->~T();
+            *reinterpret_cast<void **>(obj) = freeList;
+            freeList = obj;
+            inUse--;
+        }
+
+        // 正在使用的对象数和向系统申请的总字节数
+        size_t inUseCount() const { return inUse; }
+        size_t reservedBytes() const { return reserved; }
+
+    private:
+        // 每个对象按T的对齐要求向上取整，保证连续切分时仍然对齐
+        static constexpr size_t OBJECT_SIZE = (sizeof(T) + alignof(T) - 1) / alignof(T) * alignof(T);
+        static constexpr size_t CHUNK_SIZE = 128 * 1024;
+
+        char *chunk = nullptr;    // 当前大块中尚未切分的部分
+        size_t remaining = 0;     // 当前大块剩余字节数
+        void *freeList = nullptr; // 已释放对象的链表
+        size_t inUse = 0;
+        size_t reserved = 0;
+    };
+}
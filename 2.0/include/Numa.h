@@ -0,0 +1,17 @@
+#pragma once
+#include "./Common.h"
+namespace Memory_Pool
+{
+    // NUMA拓扑探测与内存绑定，直接读取sysfs并调用系统调用，不依赖libnuma
+    // 单节点机器、非Linux平台或探测失败时按只有0号节点处理，所有调用都退化为空操作
+
+    // 系统的NUMA节点数，首次调用时探测并缓存，不超过MAX_NUMA_NODES
+    size_t numaNodeCount();
+
+    // 当前线程所在CPU的NUMA节点
+    size_t currentNumaNode();
+
+    // 将[addr, addr + bytes)的物理页优先分配在node节点上，节点内存不足时内核仍可回退到其他节点
+    // 只影响之后首次访问分配的页，失败时返回false，调用方可以忽略
+    bool numaBind(void *addr, size_t bytes, size_t node);
+}
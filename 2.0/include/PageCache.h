@@ -1,43 +1,205 @@
 #pragma once
 #include "./Common.h"
+#include "./PageMap.h"
+#include "./MetadataArena.h"
 #include <mutex>
-#include <map>
+#include <chrono>
+#include <iosfwd>
 namespace Memory_Pool
 {
+    // 由若干连续页组成的内存区间
+    struct Span
+    {
+        void *pageAddr = nullptr; // 页起始地址
+        size_t numPages = 0;      // 页数
+        Span *next = nullptr;     // 双向链表指针，空闲时位于页缓存，已切分时位于中心缓存
+        Span *prev = nullptr;
+        size_t sizeClass = 0;     // 切分成的小对象大小类，0表示空闲或未切分
+        bool isFree = false;      // 是否在页缓存的空闲链表中
+        bool isReleasing = false; // 已移出空闲链表、正在锁外归还物理页，不能被分配、合并或再次释放
+        size_t releasedPages = 0; // 空闲span中物理页已通过madvise归还系统的页数
+        bool isZeroed = false;    // 空闲span的内容是否确定全为0（新映射或已整体归还系统的页）
+        size_t node = 0;          // 所属页堆的NUMA节点，分割与合并都不会跨节点
+
+        // 尚未归还系统的空闲span按释放时间串成链表，用于延迟归还
+        uint64_t freedAt = 0;     // 进入空闲链表的时间（纳秒）
+        Span *dirtyPrev = nullptr;
+        Span *dirtyNext = nullptr;
+
+        // 以下字段仅在span被中心缓存切分为小对象后使用，受对应大小类的锁保护
+        void *freeList = nullptr; // span内空闲的小对象链表
+        size_t useCount = 0;      // 已分配出去的小对象数
+        size_t objectCount = 0;   // 切分出的小对象总数
+        size_t bucket = 0;        // 在中心缓存中按占用率所处的分组
+    };
+
+    // 空闲span的选择策略，两者都取页数最小的足够大的span，区别在同样页数的span之间如何选择
+    enum class SpanPolicy
+    {
+        Lifo,           // 取链表表头，即最近释放的span，插入为O(1)（默认）
+        AddressOrdered, // 链表按地址排序，取地址最低的span，使存活的span集中在低地址，高地址更容易合并成大块
+    };
+
     // 页缓存类，负责管理内存页的分配和回收
     class PageCache
     {
     public:
-        static const size_t PAGE_SIZE = 4096; // 假设每页大小为4KB
-
         static PageCache &getInstance()
         {
             static PageCache instance;
             return instance;
         }
 
-        // 分配一页内存
-        void *allocatePage(size_t numPages);
+        // 分配numPages页组成的span，sizeClass记录该span将被切分成的大小类
+        // 优先从当前CPU所在NUMA节点的页堆分配，zeroed为true时保证内容全为0，只有不能确定为0的页才在锁外清零
+        Span *allocateSpan(size_t numPages, size_t sizeClass = 0, bool zeroed = false);
+
+        // 分配一页内存，返回页起始地址
+        void *allocatePage(size_t numPages, size_t sizeClass = 0)
+        {
+            Span *span = allocateSpan(numPages, sizeClass);
+            return span ? span->pageAddr : nullptr;
+        }
 
         // 释放一页内存
         void deallocatePage(void *ptr, size_t numPages);
 
-    private:
-        PageCache() = default;
-        //向系统申请内存
-        void *systemAlloc(size_t size);
+        // 设置空闲页归还系统的延迟：空闲超过decay的span通过madvise释放物理页，0表示立即释放
+        // 只在分配或释放span时顺带检查，每次最多归还MAX_RELEASE_BATCH个span；
+        // 进程空闲后不会再有检查，此时只有releaseFreeMemory()能保证归还
+        void setReleaseDecay(std::chrono::milliseconds decay)
+        {
+            decayNanos.store(std::chrono::duration_cast<std::chrono::nanoseconds>(decay).count(),
+                             std::memory_order_relaxed);
+        }
+        // 立即将所有空闲span的物理页归还系统，返回本次归还的字节数
+        size_t releaseFreeMemory();
+
+        // 大页模式：按2MB对齐的整块向系统申请并标记MADV_HUGEPAGE，小span优先从已部分使用的大页中切分，
+        // 归还时只释放完整空闲的大页，不拆散正在使用的大页。只影响之后的申请和归还
+        void setHugePages(bool enable)
+        {
+            hugePages.store(enable, std::memory_order_relaxed);
+        }
+
+        // 设置空闲span的选择策略，切换到按地址排序时会将现有链表重新排序
+        void setSpanPolicy(SpanPolicy policy);
+        SpanPolicy spanPolicy() const
+        {
+            return policy.load(std::memory_order_relaxed);
+        }
+
+        // 设置下一次预留的地址空间大小，之后每次预留按两倍增长
+        void setReserveSize(size_t bytes)
+        {
+            reserveSize.store(bytes, std::memory_order_relaxed);
+        }
+
+        // 输出空闲页和已归还页的统计，多节点时按节点分别输出
+        void printStats(std::ostream &os);
+
+        // 页堆数，即探测到的NUMA节点数，单节点机器上为1
+        size_t nodeCount() const { return numNodes; }
+
+        // 查找地址所在的span，无需加锁，不是页缓存分配的地址返回nullptr
+        Span *lookupSpan(void *ptr) const
+        {
+            return pageMap.get(reinterpret_cast<uintptr_t>(ptr) >> PAGE_SHIFT);
+        }
+
+        // 查找地址所属的小对象大小类，不属于任何大小类返回0
+        size_t getSizeClass(void *ptr) const
+        {
+            Span *span = lookupSpan(ptr);
+            return span ? span->sizeClass : 0;
+        }
 
     private:
-        struct Span
+        // 每个NUMA节点一个页堆，各自持有空闲链表、预留区和锁，预留区通过mbind绑定到所属节点
+        struct alignas(CACHE_LINE_SIZE) NodeHeap
         {
-            void *pageAddr;  // 页起始地址
-            size_t numPages; // 页数
-            Span *next;      // 链表指针
+            size_t node = 0;
+            // 不超过MAX_BUCKET_PAGES页的空闲span按页数放入对应的双向链表，下标为页数减1
+            Span *smallSpans[MAX_BUCKET_PAGES] = {};
+            // 非空链表的位图，查找时用tzcnt直接定位第一个足够大的链表
+            uint64_t smallBits[MAX_BUCKET_PAGES / 64] = {};
+            // 更大的空闲span按地址从低到高串成双向链表，数量通常很少
+            Span *largeSpans = nullptr;
+            // Span记录的分配器，不经过全局new，受mtx保护
+            MetadataArena<Span> spanArena;
+            // 尚未归还系统的空闲span，按释放时间从旧到新排列
+            Span *dirtyHead = nullptr;
+            Span *dirtyTail = nullptr;
+            size_t totalFreePages = 0;     // 空闲span的总页数
+            size_t totalReleasedPages = 0; // 其中物理页已归还系统的页数
+            size_t hugeRegions = 0;        // 大页模式下申请的2MB区域数
+            // 当前预留区中尚未切分的部分
+            char *reserveCursor = nullptr;
+            char *reserveEnd = nullptr;
+            size_t reservedBytes = 0; // 累计预留的地址空间
+            size_t reservations = 0;  // 预留次数
+            std::mutex mtx;           // 互斥锁，保护该节点页堆的多线程访问
         };
-        // 按页数管理空闲span，不同页数对应不同Span链表
-        std::map<size_t, Span *> freeSpans;
-        // 页号到span的映射，用于回收
-        std::map<void *, Span *> spanMap;
-        std::mutex mtx; // 互斥锁，保护多线程访问
+
+        PageCache();
+        // 在持有heap锁的情况下分配span，grow为false时只使用已有的空闲span
+        Span *allocateSpanLocked(NodeHeap &heap, size_t numPages, size_t sizeClass, bool grow);
+        // 从预留的地址空间中切出numPages页，huge为true时按大页对齐，新切出的页由内核保证为0
+        void *systemAlloc(NodeHeap &heap, size_t numPages, bool huge);
+        // 预留至少minBytes的连续地址空间，调用方需持有锁
+        bool reserve(NodeHeap &heap, size_t minBytes);
+        // 将预留区中[start, end)这段从未使用的地址作为空闲span
+        void addUntouchedSpan(NodeHeap &heap, char *start, char *end);
+
+        // 将不在空闲链表中的span从numPages页处一分为二，返回后一部分，元数据不足时返回nullptr
+        Span *splitSpan(NodeHeap &heap, Span *span, size_t numPages);
+        // 与相邻的空闲span合并，span本身不在空闲链表中
+        // 只合并isZeroed相同的span：脏页与干净页分开管理，合并后干净的部分不会被重新清零或重复madvise
+        // 大页模式例外：脏页吸收干净邻居中与它共用大页的部分，整块大页才能作为一个span归还
+        void coalesce(NodeHeap &heap, Span *span);
+        // 将span的每一页都记录到页映射中，用于已分配span的无大小释放
+        void registerSpan(Span *span);
+        // 只记录span的首页和尾页，用于空闲span的合并
+        void registerBoundary(Span *span);
+        // 查找至少numPages页的空闲span：先在页数链表中取最小的非空链表，再在大span中按地址顺序最佳匹配
+        static Span *findFreeSpan(NodeHeap &heap, size_t numPages);
+        // 将空闲span加入或移出空闲链表，页数链表在默认策略下为O(1)，大span链表插入时按地址查找位置
+        void insertFreeSpan(NodeHeap &heap, Span *span, uint64_t freedAt);
+        // 将span按地址顺序插入以head开头的双向链表
+        static void insertByAddress(Span *&head, Span *span);
+        // 将以head开头的双向链表按地址从低到高重新排序
+        static void sortByAddress(Span *&head);
+        void removeFreeSpan(NodeHeap &heap, Span *span);
+        // 空闲span是否在待归还链表中
+        static bool isQueued(const NodeHeap &heap, Span *span)
+        {
+            return span->dirtyPrev != nullptr || heap.dirtyHead == span;
+        }
+        // 待归还链表表头是否已空闲超过延迟，调用方需持有锁
+        bool hasExpired(const NodeHeap &heap, uint64_t now) const
+        {
+            return heap.dirtyHead != nullptr &&
+                   heap.dirtyHead->freedAt + decayNanos.load(std::memory_order_relaxed) <= now;
+        }
+        // 计算span中可归还物理页的范围，大页模式下只取完整的大页，返回页数
+        size_t releasableRange(Span *span, char *&start) const;
+        // 归还空闲时间超过延迟的span，调用方不能持有锁
+        // 持锁取出一批span移出空闲链表，在锁外madvise后再放回；非force时只处理一批，force时归还now之前释放的全部span
+        size_t releaseExpired(NodeHeap &heap, uint64_t now, bool force);
+
+    private:
+        NodeHeap heaps[MAX_NUMA_NODES];
+        size_t numNodes = 1;
+        // 页号到span的基数树，无需加锁即可O(1)查找
+        // 已分配span记录每一页，空闲span只保证首尾页正确
+        PageMap pageMap;
+        // 各节点并发预留时串行化页映射节点的创建
+        std::mutex mapMtx;
+        std::atomic<bool> hugePages{false};
+        std::atomic<SpanPolicy> policy{SpanPolicy::Lifo};
+        // 下一次预留的大小，默认1GB，每次预留后翻倍
+        std::atomic<size_t> reserveSize{size_t(1) << 30};
+        // 空闲页归还系统的延迟，默认10秒
+        std::atomic<int64_t> decayNanos{10'000'000'000};
     };
 }
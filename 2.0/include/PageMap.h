@@ -0,0 +1,67 @@
+#pragma once
+#include "./Common.h"
+namespace Memory_Pool
+{
+    struct Span;
+
+    // 三级基数树，将页号映射到所属的Span，查找为O(1)
+    // 读操作无需加锁；同一页的写操作由所属节点页堆的锁串行化，节点创建由PageCache的mapMtx串行化
+    // 节点通过metadataAlloc直接向系统申请，不依赖malloc
+    class PageMap
+    {
+    public:
+        // 查找页号对应的Span，未记录返回nullptr
+        Span *get(size_t pageId) const
+        {
+            if ((pageId >> (LEAF_BITS + NODE_BITS)) >= ROOT_LENGTH)
+            {
+                return nullptr;
+            }
+            Node *node = root[pageId >> (LEAF_BITS + NODE_BITS)].load(std::memory_order_acquire);
+            if (node == nullptr)
+            {
+                return nullptr;
+            }
+            Leaf *leaf = node->leaves[(pageId >> LEAF_BITS) & (NODE_LENGTH - 1)].load(std::memory_order_acquire);
+            if (leaf == nullptr)
+            {
+                return nullptr;
+            }
+            return leaf->spans[pageId & (LEAF_LENGTH - 1)].load(std::memory_order_relaxed);
+        }
+
+        // 记录页号对应的Span，调用前需保证ensure已成功
+        void set(size_t pageId, Span *span)
+        {
+            Node *node = root[pageId >> (LEAF_BITS + NODE_BITS)].load(std::memory_order_relaxed);
+            Leaf *leaf = node->leaves[(pageId >> LEAF_BITS) & (NODE_LENGTH - 1)].load(std::memory_order_relaxed);
+            leaf->spans[pageId & (LEAF_LENGTH - 1)].store(span, std::memory_order_relaxed);
+        }
+
+        // 确保[start, start + numPages)范围内的节点都已创建
+        bool ensure(size_t start, size_t numPages);
+
+    private:
+        // 48位虚拟地址、4KB页，页号共36位，按12/12/12划分
+        static constexpr size_t LEAF_BITS = 12;
+        static constexpr size_t NODE_BITS = 12;
+        static constexpr size_t ROOT_BITS = 12;
+        static constexpr size_t LEAF_LENGTH = size_t(1) << LEAF_BITS;
+        static constexpr size_t NODE_LENGTH = size_t(1) << NODE_BITS;
+        static constexpr size_t ROOT_LENGTH = size_t(1) << ROOT_BITS;
+
+        struct Leaf
+        {
+            std::atomic<Span *> spans[LEAF_LENGTH];
+        };
+        struct Node
+        {
+            std::atomic<Leaf *> leaves[NODE_LENGTH];
+        };
+
+        // 通过mmap申请清零的节点内存
+        static void *allocNode(size_t bytes);
+
+        std::array<std::atomic<Node *>, ROOT_LENGTH> root{};
+    };
+}
@@ -7,25 +7,130 @@ namespace Memory_Pool
     public:
         static ThreadCache *getInstance()
         {
-            static thread_local ThreadCache instance;
-            return &instance;
+            ThreadCache *cache = current;
+            if (MEMORY_POOL_UNLIKELY(cache == nullptr))
+            {
+                cache = createInstance();
+            }
+            return cache;
         }
-        void *allocate(size_t size);
-        void deallocate(void *ptr, size_t size);
+
+        // 快速路径：只操作线程本地自由链表，不发生函数调用
+        void *allocate(size_t size)
+        {
+            if (MEMORY_POOL_UNLIKELY(size > MAX_SIZE))
+            {
+                return allocateLarge(size);
+            }
+            return allocateClass(SizeClass::getIndex(size));
+        }
+
+        void deallocate(void *ptr, size_t size)
+        {
+            if (MEMORY_POOL_UNLIKELY(size > MAX_SIZE))
+            {
+                deallocateLarge(ptr);
+                return;
+            }
+            deallocateClass(ptr, SizeClass::getIndex(size));
+        }
+
+        // 按已知的大小类分配，大小类可在编译期确定
+        void *allocateClass(size_t index)
+        {
+            FreeList &list = free_list[index];
+            void *ptr = list.head;
+            // 链表为空，从中心缓存获取一批内存
+            if (MEMORY_POOL_UNLIKELY(ptr == nullptr))
+            {
+                return fetchFromCentalCache(index);
+            }
+            list.head = *reinterpret_cast<void **>(ptr);
+            // 更新自由链表大小和低水位
+            if (--list.length < list.lowWater)
+            {
+                list.lowWater = list.length;
+            }
+            cacheSize -= SizeClass::classSize(index);
+            return ptr;
+        }
+
+        // 按已知的大小类释放
+        void deallocateClass(void *ptr, size_t index)
+        {
+            FreeList &list = free_list[index];
+            // 将内存块添加到线程本地自由链表
+            *reinterpret_cast<void **>(ptr) = list.head;
+            list.head = ptr;
+            list.length++;
+            cacheSize += SizeClass::classSize(index);
+            // 判断是否需要将部分内存回收给中心缓存
+            if (MEMORY_POOL_UNLIKELY(list.length > list.maxLength))
+            {
+                listTooLong(index);
+            }
+            else if (MEMORY_POOL_UNLIKELY(cacheSize > maxCacheSize.load(std::memory_order_relaxed)))
+            {
+                scavenge();
+            }
+        }
+
+        // 大对象以整个span从页缓存分配，经由大对象缓存复用
+        MEMORY_POOL_COLD static void *allocateLarge(size_t size);
+        // 内容全为0的大对象
+        MEMORY_POOL_COLD static void *allocateLargeZeroed(size_t size);
+        MEMORY_POOL_COLD static void deallocateLarge(void *ptr);
+
+        // 批量分配num个相同大小的内存块写入out，返回实际分配的块数
+        size_t allocateBatch(size_t size, size_t num, void **out);
+        // 批量释放num个相同大小的内存块
+        void deallocateBatch(void **ptrs, size_t num, size_t size);
+
+        // 设置所有线程缓存共享的总字节数预算
+        static void setMaxTotalCacheSize(size_t bytes);
 
     private:
-        ThreadCache() = default;
+        ThreadCache();
+        // 首次使用时创建本线程的缓存
+        MEMORY_POOL_COLD static ThreadCache *createInstance();
+        // 线程退出时将所有自由链表归还中心缓存，避免内存随线程销毁而丢失
+        // 之后缓存进入直通模式：其他线程局部对象析构时的释放直接归还中心缓存，分配每次只取一块
+        void teardown();
         // 从中心缓存获取内存
-        void *fetchFromCentalCache(size_t index);
-        // 将内存返回到中心缓存
-        void returnToCentralCache(void *ptr, size_t size);
-        // 计算批量获取内存快的数量
-        size_t getBatchNum(size_t size) const;
-        // 判断是否需要归还内存给中心缓存
-        bool shouldReturnToCentralCache(size_t index);
+        MEMORY_POOL_COLD void *fetchFromCentalCache(size_t index);
+        // 链表过长时归还一批内存给中心缓存，并调整链表上限
+        MEMORY_POOL_COLD void listTooLong(size_t index);
+        // 从链表头部取出num个内存块归还给中心缓存
+        void returnToCentralCache(size_t index, size_t num);
+        // 缓存总字节数超过上限时，按低水位回收各链表中闲置的内存
+        MEMORY_POOL_COLD void scavenge();
+        // 缓存容量不足时，从全局预算或最久未活跃的线程缓存中挪取容量
+        void increaseCacheLimit();
+        // 记录最近一次进入慢路径的时间
+        void touch();
+        // 大小类链表长度上限的最大值，同时受块数和字节数约束
+        static size_t maxListLength(size_t index);
 
     private:
-        std::array<void *, FREE_LIST_SIZE> free_list;
-        std::array<size_t, FREE_LIST_SIZE> free_list_size; // 自由链表大小统计
+        // 每个大小类的链表头、长度和上限放在一起，保证位于同一缓存行
+        struct alignas(32) FreeList
+        {
+            void *head = nullptr;   // 链表头
+            uint32_t length = 0;    // 链表长度
+            uint32_t maxLength = 1; // 链表长度上限，超过则归还中心缓存，慢启动从1开始增长
+            uint32_t lowWater = 0;  // 两次回收之间链表长度的最小值
+            uint32_t overages = 0;  // 链表超过上限的累计次数
+        };
+        alignas(CACHE_LINE_SIZE) std::array<FreeList, FREE_LIST_SIZE> free_list;
+        size_t cacheSize = 0;                 // 当前缓存的总字节数
+        std::atomic<size_t> maxCacheSize{0};  // 缓存总字节数上限，可能被其他线程窃取而减小
+        std::atomic<uint64_t> lastActive{0};  // 最近一次进入慢路径的时间，用于挑选窃取对象
+        ThreadCache *prev = nullptr;          // 全局线程缓存链表，受注册表锁保护
+        ThreadCache *next = nullptr;
+        bool tornDown = false;                // 线程已开始退出，缓存不再保留任何内存块
+
+        // 指向本线程缓存的指针，常量初始化，访问时无需线程局部变量的初始化检查
+        // 缓存对象可平凡析构，线程退出期间存储一直有效，teardown之后指针仍然可用
+        static inline thread_local ThreadCache *current = nullptr;
     };
 }
@@ -0,0 +1,58 @@
+#include "../include/AdaptiveLock.h"
+#include <chrono>
+#include <thread>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+namespace Memory_Pool
+{
+    // 休眠前的自旋次数，临界区很短时通常能在自旋阶段拿到锁
+    static const int SPIN_LIMIT = 100;
+
+    static inline void cpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    void AdaptiveLock::lockSlow()
+    {
+        auto start = std::chrono::steady_clock::now();
+        // 1. 短暂自旋，只在锁看起来空闲时才尝试CAS，避免反复抢占缓存行
+        bool acquired = false;
+        for (int i = 0; i < SPIN_LIMIT && !acquired; i++)
+        {
+            cpuRelax();
+            uint32_t expected = 0;
+            acquired = state.load(std::memory_order_relaxed) == 0 &&
+                       state.compare_exchange_weak(expected, 1, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+        // 2. 标记有等待者并休眠，被唤醒后重新抢锁
+        // 以状态2持有锁，保证解锁时会唤醒其他可能休眠的线程
+        while (!acquired && state.exchange(2, std::memory_order_acquire) != 0)
+        {
+#ifdef __linux__
+            syscall(SYS_futex, reinterpret_cast<uint32_t *>(&state), FUTEX_WAIT_PRIVATE, 2, nullptr, nullptr, 0);
+#else
+            std::this_thread::yield();
+#endif
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        waits.store(waits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        waitTime.store(waitTime.load(std::memory_order_relaxed) +
+                           std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                       std::memory_order_relaxed);
+    }
+
+    void AdaptiveLock::wake()
+    {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif
+    }
+}
@@ -1,144 +1,404 @@
 #include "../include/CentralCache.h"
 #include "../include/PageCache.h"
-#include <thread>
+#include "../include/MetadataArena.h"
+#include "../include/Numa.h"
+#include <iomanip>
+#include <ostream>
+#include <sched.h>
+#include <unistd.h>
 
 namespace Memory_Pool
 {
-    // 每次从PageCache获取span大小（以页为单位）
-    static const size_t SPAN_PAGES = 8;
+    CentralCache::CentralCache()
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_CONF);
+        size_t numCpus = cpus > 0 ? static_cast<size_t>(cpus) : 1;
+        numNodes = numaNodeCount();
+        // 每个节点按其平均CPU数分片，单节点时与按CPU分组相同
+        size_t cpusPerNode = (numCpus + numNodes - 1) / numNodes;
+        shardsPerNode = (cpusPerNode + CPUS_PER_SHARD - 1) / CPUS_PER_SHARD;
+        numShards = numNodes * shardsPerNode;
+        // 分片数组和span分组通过元数据分配器创建，不经过全局new
+        transfer_cache = metadataNewArray<TransferCache>(numShards * FREE_LIST_SIZE);
+        span_lists = metadataNewArray<SpanLists>(numNodes * FREE_LIST_SIZE);
+    }
 
-    void *CentralCache::fetchRange(size_t index, size_t batchNum)
+    size_t CentralCache::fetchRange(void *&start, void *&end, size_t index, size_t batchNum)
     {
         if (index >= FREE_LIST_SIZE || batchNum == 0)
         {
-            return nullptr; // 索引越界或批量数为0
+            return 0; // 索引越界或批量数为0
+        }
+        Batch batch;
+        if (batchNum >= SizeClass::numToMove(index) && popBatch(index, batch))
+        {
+            // 中转缓存中有完整批次，O(1)取出
+            start = batch.head;
+            end = batch.tail;
+            return batch.count;
+        }
+
+        // 只取当前节点span中的对象，避免本节点的线程长期使用远端内存
+        size_t node = currentNumaNode();
+        lock(index);
+        size_t count = fetchFromSpans(start, end, index, batchNum, node);
+        unlock(index);
+        if (count > 0)
+        {
+            return count;
+        }
+
+        if (popBatch(index, batch))
+        {
+            // 慢启动阶段请求不足一个批次，span中又没有空闲对象时，拆分中转缓存中的批次
+            void *split = batch.head;
+            for (size_t i = 1; i < batchNum && i < batch.count; i++)
+            {
+                split = *reinterpret_cast<void **>(split);
+            }
+            void *rest = *reinterpret_cast<void **>(split);
+            *reinterpret_cast<void **>(split) = nullptr;
+            start = batch.head;
+            end = split;
+            count = std::min(batchNum, batch.count);
+            // 剩余部分放回所属span
+            Span *releaseList = nullptr;
+            lock(index);
+            releaseToSpans(rest, index, releaseList);
+            unlock(index);
+            releaseSpans(releaseList);
+            return count;
+        }
+
+        // span中没有空闲对象，在锁外向页缓存申请新的span并切分
+        Span *span = fetchFromPageCache(index);
+        if (span == nullptr)
+        {
+            // 页缓存无法再分配时，退而使用其他节点span中的空闲对象
+            lock(index);
+            for (size_t i = 1; count == 0 && i < numNodes; i++)
+            {
+                count = fetchFromSpans(start, end, index, batchNum, (node + i) % numNodes);
+            }
+            unlock(index);
+            return count;
         }
-        // 自旋锁保护
-        while (locks[index].test_and_set(std::memory_order_acquire))
+        // 页缓存在本节点无法扩容时可能返回其他节点的span，按span所属节点放入分组
+        lock(index);
+        spanLists(span->node, index).spanCount++;
+        linkSpan(span, index);
+        count = fetchFromSpans(start, end, index, batchNum, span->node);
+        unlock(index);
+        return count; // 返回实际获取的块数
+    }
+
+    void CentralCache::returnRange(void *start, void *end, size_t index, size_t batchNum)
+    {
+        if (start == nullptr || index >= FREE_LIST_SIZE)
         {
-            std::this_thread::yield(); // 添加线程让步，避免忙等待，避免过度消耗CPU
+            return;
+        }
+        if (batchNum == SizeClass::numToMove(index) && pushBatch(index, {start, end, batchNum}))
+        {
+            // 完整批次放入中转缓存，不触碰已释放的内存块
+            return;
         }
+        // 逐个放回所属span
+        Span *releaseList = nullptr;
+        lock(index);
+        releaseToSpans(start, index, releaseList);
+        unlock(index);
+        releaseSpans(releaseList);
+    }
 
-        void *result = nullptr;
-        try
+    void CentralCache::flushTransferCaches()
+    {
+        for (size_t index = 1; index < FREE_LIST_SIZE; index++)
         {
-            result = central_free_list[index].load(std::memory_order_relaxed);
-            if (result == nullptr)
+            // 窃取不跨节点，逐个分片清空
+            for (size_t shard = 0; shard < numShards; shard++)
             {
-                // 如果中心缓存为空，从页缓存获取新的内存块
-                size_t size = (index + 1) * ALIGNMENT;
-                result = fetchFromPageCache(size);
-                if (result == nullptr)
+                Batch batch;
+                while (takeBatch(transferCache(shard, index), batch))
                 {
-                    locks[index].clear(std::memory_order_release);
-                    return nullptr;
+                    Span *releaseList = nullptr;
+                    lock(index);
+                    releaseToSpans(batch.head, index, releaseList);
+                    unlock(index);
+                    releaseSpans(releaseList);
                 }
-                // 将从PageCache获取的内存块切分成小块
-                char *start = static_cast<char *>(result);
-                size_t totalBlocks = (SPAN_PAGES * PageCache::PAGE_SIZE) / size;
-                size_t allocBlocks = std::min(batchNum, totalBlocks);
-                // 构建返回给ThreadCache的内存块链表
-                if (allocBlocks > 1)
+            }
+        }
+    }
+
+    size_t CentralCache::currentShard() const
+    {
+        if (numShards == 1)
+        {
+            return 0;
+        }
+        // 先定位节点，再在节点内按CPU分组
+        size_t base = numNodes > 1 ? currentNumaNode() * shardsPerNode : 0;
+#ifdef __linux__
+        // glibc通过rseq或vDSO读取CPU编号，不需要系统调用
+        int cpu = sched_getcpu();
+        return base + (cpu < 0 ? 0 : static_cast<size_t>(cpu) / CPUS_PER_SHARD % shardsPerNode);
+#else
+        return base;
+#endif
+    }
+
+    bool CentralCache::popBatch(size_t index, Batch &batch)
+    {
+        size_t local = currentShard();
+        size_t base = local - local % shardsPerNode;
+        for (size_t i = 0; i < shardsPerNode; i++)
+        {
+            if (takeBatch(transferCache(base + (local - base + i) % shardsPerNode, index), batch))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool CentralCache::takeBatch(TransferCache &transfer, Batch &batch)
+    {
+        // 不加锁先检查，避免为空分片争抢锁
+        if (transfer.used.load(std::memory_order_relaxed) == 0)
+        {
+            return false;
+        }
+        transfer.lock.lock();
+        size_t used = transfer.used.load(std::memory_order_relaxed);
+        bool found = used > 0;
+        if (found)
+        {
+            batch = transfer.slots[used - 1];
+            transfer.used.store(used - 1, std::memory_order_relaxed);
+        }
+        transfer.lock.unlock();
+        return found;
+    }
+
+    bool CentralCache::pushBatch(size_t index, const Batch &batch)
+    {
+        size_t shard = currentShard();
+        if (numNodes > 1)
+        {
+            // 保持本CPU在节点内的分组位置，只替换节点
+            size_t node = PageCache::getInstance().lookupSpan(batch.head)->node;
+            shard = node * shardsPerNode + shard % shardsPerNode;
+        }
+        TransferCache &transfer = transferCache(shard, index);
+        transfer.lock.lock();
+        size_t used = transfer.used.load(std::memory_order_relaxed);
+        bool stored = used < TRANSFER_CACHE_SLOTS;
+        if (stored)
+        {
+            transfer.slots[used] = batch;
+            transfer.used.store(used + 1, std::memory_order_relaxed);
+        }
+        transfer.lock.unlock();
+        return stored;
+    }
+
+    size_t CentralCache::fetchFromSpans(void *&start, void *&end, size_t index, size_t batchNum, size_t node)
+    {
+        size_t count = 0;
+        void *tail = nullptr;
+        SpanLists &lists = spanLists(node, index);
+        // 从占用率最高的分组开始取
+        for (size_t bucket = SPAN_BUCKETS; bucket-- > 0 && count < batchNum;)
+        {
+            while (lists.buckets[bucket] != nullptr && count < batchNum)
+            {
+                Span *span = lists.buckets[bucket];
+                unlinkSpan(span, index);
+                // 从span的空闲链表头部取出若干对象，接到结果链表尾部
+                void *first = span->freeList;
+                void *last = first;
+                size_t taken = 1;
+                while (count + taken < batchNum && *reinterpret_cast<void **>(last) != nullptr)
                 {
-                    // 确保至少有两个块才构建链表
-                    // 构建链表
-                    for (size_t i = 1; i < allocBlocks; i++)
-                    {
-                        void *current = start + (i - 1) * size;
-                        void *next = start + i * size;
-                        *reinterpret_cast<void **>(current) = next;
-                    }
-                    *reinterpret_cast<void **>(start + (allocBlocks - 1) * size) = nullptr; // 最后一个块指向nullptr
+                    last = *reinterpret_cast<void **>(last);
+                    taken++;
                 }
-                if (totalBlocks > allocBlocks)
+                span->freeList = *reinterpret_cast<void **>(last);
+                *reinterpret_cast<void **>(last) = nullptr;
+                span->useCount += taken;
+                if (tail == nullptr)
                 {
-                    void *remainStart = start + allocBlocks * size;
-                    for (size_t i = allocBlocks + 1; i < totalBlocks; i++)
-                    {
-                        void *current =start + (i - 1) * size;
-                        void *next = start + i * size;
-                        *reinterpret_cast<void **>(current) = next;
-                    }
-                    *reinterpret_cast<void **>(start + (totalBlocks - 1) * size) = nullptr; // 最后一个块指向nullptr
-                    // 将剩余的内存块返回到中心缓存
-                    central_free_list[index].store(remainStart, std::memory_order_release);
+                    start = first;
                 }
-            }
-            else // 如果中心缓存有index对应大小的内存块
-            {
-                // 从现有链表中获取指定数量的块
-                void *current = result;
-                void *prev = nullptr;
-                size_t count = 0;
-                while (current != nullptr && count < batchNum)
+                else
                 {
-                    prev = current;
-                    current = *reinterpret_cast<void **>(current);
-                    count++;
+                    *reinterpret_cast<void **>(tail) = first;
                 }
-                if (prev)
+                tail = last;
+                count += taken;
+                // 仍有空闲对象的span按新的占用率重新分组
+                if (span->freeList != nullptr)
                 {
-                    *reinterpret_cast<void **>(prev) = nullptr; // 最后一个块指向nullptr
+                    linkSpan(span, index);
                 }
-                central_free_list[index].store(current, std::memory_order_release); // 更新中心缓存
             }
         }
-        catch (...)
+        end = tail;
+        return count;
+    }
+
+    void CentralCache::releaseToSpans(void *start, size_t index, Span *&releaseList)
+    {
+        PageCache &pageCache = PageCache::getInstance();
+        while (start != nullptr)
         {
-            locks[index].clear(std::memory_order_release);
-            throw; // 重新抛出异常
+            void *next = *reinterpret_cast<void **>(start);
+            // 通过页映射O(1)找到对象所属的span
+            Span *span = pageCache.lookupSpan(start);
+            // 有空闲对象的span一定在某个分组中
+            if (span->freeList != nullptr)
+            {
+                unlinkSpan(span, index);
+            }
+            *reinterpret_cast<void **>(start) = span->freeList;
+            span->freeList = start;
+            if (--span->useCount == 0)
+            {
+                // span中所有对象都已空闲，准备归还页缓存
+                spanLists(span->node, index).spanCount--;
+                span->next = releaseList;
+                releaseList = span;
+            }
+            else
+            {
+                linkSpan(span, index);
+            }
+            start = next;
         }
-        locks[index].clear(std::memory_order_release); // 释放锁
-        return result;                                 // 返回获取的内存块
     }
 
-    void CentralCache::returnRange(void *ptr, size_t index, size_t batchNum)
+    void CentralCache::releaseSpans(Span *releaseList)
     {
-        if (ptr == nullptr || index >= FREE_LIST_SIZE)
+        // 在锁外将完全空闲的span归还页缓存，供其他大小类复用
+        while (releaseList != nullptr)
         {
-            return;
+            Span *span = releaseList;
+            releaseList = span->next;
+            span->freeList = nullptr;
+            PageCache::getInstance().deallocatePage(span->pageAddr, span->numPages);
         }
-        while (locks[index].test_and_set(std::memory_order_acquire))
+    }
+
+    void CentralCache::linkSpan(Span *span, size_t index)
+    {
+        // 占用率越高分组越大，范围[0, SPAN_BUCKETS)
+        span->bucket = span->useCount * SPAN_BUCKETS / span->objectCount;
+        Span *&head = spanLists(span->node, index).buckets[span->bucket];
+        span->prev = nullptr;
+        span->next = head;
+        if (head)
         {
-            std::this_thread::yield(); // 添加线程让步，避免忙等待，避免过度消耗CPU
+            head->prev = span;
         }
-        try
+        head = span;
+    }
+
+    void CentralCache::unlinkSpan(Span *span, size_t index)
+    {
+        if (span->prev)
         {
-            // 找到要归还的链表的最后一个节点
-            void *end = ptr;
-            size_t count = 1;
-            while (*reinterpret_cast<void **>(end) != nullptr && count < batchNum)
-            {
-                end = *reinterpret_cast<void **>(end);
-                count++;
-            }
-            // 将归还的链表连接到中心缓存的链表头部
-            void *current = central_free_list[index].load(std::memory_order_relaxed);
-            *reinterpret_cast<void **>(end) = current;                      // 将归还的链表的最后一个节点指向中心缓存的链表头部
-            central_free_list[index].store(ptr, std::memory_order_release); // 更新中心缓存
+            span->prev->next = span->next;
         }
-        catch (...)
+        else
         {
-            locks[index].clear(std::memory_order_release);
-            throw; // 重新抛出异常
+            spanLists(span->node, index).buckets[span->bucket] = span->next;
         }
-        locks[index].clear(std::memory_order_release);
+        if (span->next)
+        {
+            span->next->prev = span->prev;
+        }
+        span->prev = span->next = nullptr;
     }
 
-    void *CentralCache::fetchFromPageCache(size_t size)
+    void CentralCache::lock(size_t index)
     {
-        // 1. 计算实际需要的页数
-        size_t numPages = (size + PageCache::PAGE_SIZE - 1) / PageCache::PAGE_SIZE;
-        // 2. 根据大小决定分配策略
-        if (size <= SPAN_PAGES * PageCache::PAGE_SIZE)
+        locks[index].lock();
+    }
+
+    void CentralCache::unlock(size_t index)
+    {
+        locks[index].unlock();
+    }
+
+    void CentralCache::printStats(std::ostream &os) const
+    {
+        os << "CentralCache (" << numShards << " transfer cache shards";
+        if (numNodes > 1)
         {
-            // 小于等于32KB的请求，使用固定8页
-            return PageCache::getInstance().allocatePage(SPAN_PAGES);
+            os << " on " << numNodes << " nodes";
         }
-        else
+        os << ", classes with spans or lock waits):" << std::endl;
+        os << "  class    size  pages  objs  waste%  spans  waste(KB)   waits  waited(ms)" << std::endl;
+        size_t totalWaste = 0;
+        uint64_t totalWaits = 0;
+        uint64_t totalNanos = 0;
+        for (size_t index = 1; index < FREE_LIST_SIZE; index++)
+        {
+            // span分组的锁和各分片中转缓存的锁合并统计
+            uint64_t waits = locks[index].waitCount();
+            uint64_t nanos = locks[index].waitNanos();
+            for (size_t shard = 0; shard < numShards; shard++)
+            {
+                const AdaptiveLock &lock = transfer_cache[shard * FREE_LIST_SIZE + index].lock;
+                waits += lock.waitCount();
+                nanos += lock.waitNanos();
+            }
+            size_t spans = 0;
+            for (size_t node = 0; node < numNodes; node++)
+            {
+                spans += spanLists(node, index).spanCount.load(std::memory_order_relaxed);
+            }
+            if (spans == 0 && waits == 0)
+            {
+                continue;
+            }
+            // 尾部浪费：每个span末尾不足一个对象的字节
+            size_t waste = spans * SizeClass::spanWaste(index);
+            totalWaste += waste;
+            totalWaits += waits;
+            totalNanos += nanos;
+            os << "  " << std::setw(5) << index << std::setw(8) << SizeClass::classSize(index)
+               << std::setw(7) << SizeClass::classPages(index) << std::setw(6) << SizeClass::objectsPerSpan(index)
+               << std::setw(8) << std::fixed << std::setprecision(2)
+               << 100.0 * SizeClass::spanWaste(index) / (SizeClass::classPages(index) * PAGE_SIZE)
+               << std::setw(7) << spans << std::setw(11) << waste / 1024
+               << std::setw(8) << waits << std::setw(12) << std::setprecision(3) << nanos / 1e6 << std::endl;
+        }
+        os << "  total: " << totalWaste / 1024 << " KB span tail waste, " << totalWaits << " lock waits, "
+           << std::fixed << std::setprecision(3) << totalNanos / 1e6 << " ms waited" << std::endl;
+    }
+
+    Span *CentralCache::fetchFromPageCache(size_t index)
+    {
+        size_t size = SizeClass::classSize(index);
+        // 按大小类预先计算的页数申请，保证尾部浪费有上限
+        Span *span = PageCache::getInstance().allocateSpan(SizeClass::classPages(index), index);
+        if (span == nullptr)
+        {
+            return nullptr;
+        }
+        // 将span切分成小对象，串成span内的空闲链表
+        char *start = static_cast<char *>(span->pageAddr);
+        size_t totalBlocks = SizeClass::objectsPerSpan(index);
+        for (size_t i = 1; i < totalBlocks; i++)
         {
-            // 大于32KB的请求，按实际需求分配
-            return PageCache::getInstance().allocatePage(numPages);
+            *reinterpret_cast<void **>(start + (i - 1) * size) = start + i * size;
         }
+        *reinterpret_cast<void **>(start + (totalBlocks - 1) * size) = nullptr; // 最后一个块指向nullptr
+        span->freeList = start;
+        span->useCount = 0;
+        span->objectCount = totalBlocks;
+        return span;
     }
 }
@@ -0,0 +1,204 @@
+#include "../include/CpuCache.h"
+#include "../include/CentralCache.h"
+#include "../include/MetadataArena.h"
+#include "../include/LargeCache.h"
+#include <unistd.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#include <sys/syscall.h>
+#define MEMORY_POOL_HAS_RSEQ 1
+#endif
+#endif
+namespace Memory_Pool
+{
+    // 读取当前线程所在的CPU编号，失败返回负数
+    static int currentCpu()
+    {
+#ifdef MEMORY_POOL_HAS_RSEQ
+        if (__rseq_size > 0)
+        {
+            // glibc已为每个线程注册rseq，内核在线程被调度时更新cpu_id
+            auto *area = reinterpret_cast<const volatile struct rseq *>(
+                static_cast<char *>(__builtin_thread_pointer()) + __rseq_offset);
+            return static_cast<int>(area->cpu_id);
+        }
+        // glibc未注册rseq（如被tunable关闭）时由本线程自行注册
+        static thread_local struct rseq ownArea = {};
+        static thread_local bool registered = false;
+        if (!registered)
+        {
+            registered = true;
+            ownArea.cpu_id = static_cast<uint32_t>(RSEQ_CPU_ID_UNINITIALIZED);
+            if (syscall(__NR_rseq, &ownArea, sizeof(ownArea), 0, RSEQ_SIG) != 0)
+            {
+                ownArea.cpu_id = static_cast<uint32_t>(RSEQ_CPU_ID_REGISTRATION_FAILED);
+            }
+        }
+        return static_cast<int>(reinterpret_cast<volatile struct rseq &>(ownArea).cpu_id);
+#else
+        return -1;
+#endif
+    }
+
+    bool CpuCache::isAvailable()
+    {
+        static const bool available = currentCpu() >= 0;
+        return available;
+    }
+
+    CpuCache::CpuCache()
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_CONF);
+        numCpus = cpus > 0 ? static_cast<size_t>(cpus) : 1;
+        slots = metadataNewArray<CpuSlot>(numCpus);
+    }
+
+    CpuCache::CpuSlot &CpuCache::lockCurrentSlot()
+    {
+        int cpu = currentCpu();
+        CpuSlot &slot = slots[cpu < 0 ? 0 : static_cast<size_t>(cpu) % numCpus];
+        // 只有线程恰好在读取编号后被迁移时才会竞争
+        slot.lock.lock();
+        return slot;
+    }
+
+    void *CpuCache::allocate(size_t size)
+    {
+        if (size > MAX_SIZE)
+        {
+            return LargeCache::getInstance().allocate(size); // 大对象以整个span从页缓存分配
+        }
+        size_t index = SizeClass::getIndex(size);
+        CpuSlot &slot = lockCurrentSlot();
+        FreeList &list = slot.free_list[index];
+        void *ptr = list.head;
+        if (ptr != nullptr)
+        {
+            list.head = *reinterpret_cast<void **>(ptr);
+            list.length--;
+            slot.cacheSize -= SizeClass::classSize(index);
+        }
+        slot.lock.unlock();
+        if (ptr == nullptr)
+        {
+            ptr = fetchFromCentralCache(index);
+        }
+        return ptr;
+    }
+
+    void CpuCache::deallocate(void *ptr, size_t size)
+    {
+        if (size > MAX_SIZE)
+        {
+            LargeCache::getInstance().deallocate(ptr);
+            return;
+        }
+        size_t index = SizeClass::getIndex(size);
+        CpuSlot &slot = lockCurrentSlot();
+        FreeList &list = slot.free_list[index];
+        *reinterpret_cast<void **>(ptr) = list.head;
+        list.head = ptr;
+        list.length++;
+        slot.cacheSize += SizeClass::classSize(index);
+        if (MEMORY_POOL_LIKELY(list.length <= 2 * SizeClass::numToMove(index) && slot.cacheSize <= MAX_CPU_CACHE_BYTES))
+        {
+            slot.lock.unlock();
+            return;
+        }
+        unlockAndTrim(slot, index);
+    }
+
+    void CpuCache::unlockAndTrim(CpuSlot &slot, size_t index)
+    {
+        for (;;)
+        {
+            Batch batches[MAX_CPU_TRIM_BATCHES];
+            size_t count = collectOverflow(slot, index, batches, MAX_CPU_TRIM_BATCHES);
+            bool over = slot.cacheSize > MAX_CPU_CACHE_BYTES;
+            slot.lock.unlock();
+            // 中心缓存可能在锁上等待、申请或归还页，都在槽锁之外进行
+            for (size_t i = 0; i < count; i++)
+            {
+                CentralCache::getInstance().returnRange(batches[i].start, batches[i].end, batches[i].index,
+                                                        batches[i].count);
+            }
+            if (!over)
+            {
+                return;
+            }
+            slot.lock.lock();
+        }
+    }
+
+    size_t CpuCache::collectOverflow(CpuSlot &slot, size_t index, Batch *batches, size_t count)
+    {
+        size_t collected = 0;
+        // 每个链表最多缓存两个批次
+        size_t batchNum = SizeClass::numToMove(index);
+        if (slot.free_list[index].length > 2 * batchNum)
+        {
+            batches[collected++] = detachBatch(slot, index, batchNum);
+        }
+        // 整个槽不超过字节上限：超限的字节可能分散在其他大小类中，只回收当前链表无法回到上限以内
+        while (slot.cacheSize > MAX_CPU_CACHE_BYTES && collected < count)
+        {
+            size_t trimIndex = slot.trimCursor;
+            slot.trimCursor = (trimIndex + 1) % FREE_LIST_SIZE;
+            size_t length = slot.free_list[trimIndex].length;
+            if (length > 0)
+            {
+                batches[collected++] =
+                    detachBatch(slot, trimIndex, std::min<size_t>(length, SizeClass::numToMove(trimIndex)));
+            }
+        }
+        return collected;
+    }
+
+    size_t CpuCache::cachedBytes(size_t cpu)
+    {
+        CpuSlot &slot = slots[cpu % numCpus];
+        slot.lock.lock();
+        size_t bytes = slot.cacheSize;
+        slot.lock.unlock();
+        return bytes;
+    }
+
+    void *CpuCache::fetchFromCentralCache(size_t index)
+    {
+        void *start = nullptr;
+        void *end = nullptr;
+        size_t fetchNum = CentralCache::getInstance().fetchRange(start, end, index, SizeClass::numToMove(index));
+        if (fetchNum <= 1)
+        {
+            return fetchNum == 0 ? nullptr : start;
+        }
+        // 取一个返回，其余放入线程此时所在CPU的链表
+        CpuSlot &slot = lockCurrentSlot();
+        FreeList &list = slot.free_list[index];
+        *reinterpret_cast<void **>(end) = list.head;
+        list.head = *reinterpret_cast<void **>(start);
+        list.length += static_cast<uint32_t>(fetchNum - 1);
+        slot.cacheSize += (fetchNum - 1) * SizeClass::classSize(index);
+        unlockAndTrim(slot, index);
+        return start;
+    }
+
+    CpuCache::Batch CpuCache::detachBatch(CpuSlot &slot, size_t index, size_t num)
+    {
+        FreeList &list = slot.free_list[index];
+        void *start = list.head;
+        void *end = start;
+        size_t count = 1;
+        while (count < num && *reinterpret_cast<void **>(end) != nullptr)
+        {
+            end = *reinterpret_cast<void **>(end);
+            count++;
+        }
+        list.head = *reinterpret_cast<void **>(end);
+        *reinterpret_cast<void **>(end) = nullptr; // 断开摘下的链表
+        list.length -= static_cast<uint32_t>(count);
+        slot.cacheSize -= count * SizeClass::classSize(index);
+        return {start, end, count, index};
+    }
+}
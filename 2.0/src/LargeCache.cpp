@@ -0,0 +1,162 @@
+#include "../include/LargeCache.h"
+#include "../include/PageCache.h"
+#include <cstring>
+#include <ostream>
+namespace Memory_Pool
+{
+    void *LargeCache::allocate(size_t size, bool zeroed)
+    {
+        // 按页向上取整会溢出的请求不可能满足
+        if (size > SIZE_MAX - (PAGE_SIZE - 1))
+        {
+            return nullptr;
+        }
+        size_t numPages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+        if (numPages <= MAX_LARGE_CACHE_PAGES)
+        {
+            Span *span = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                span = buckets[numPages];
+                if (span != nullptr)
+                {
+                    unlink(span);
+                    hits++;
+                }
+                else
+                {
+                    misses++;
+                }
+            }
+            if (span != nullptr)
+            {
+                // 缓存的span刚被使用过，内容不确定
+                if (zeroed)
+                {
+                    memset(span->pageAddr, 0, numPages * PAGE_SIZE);
+                }
+                return span->pageAddr;
+            }
+        }
+        Span *span = PageCache::getInstance().allocateSpan(numPages, 0, zeroed);
+        return span ? span->pageAddr : nullptr;
+    }
+
+    void LargeCache::deallocate(void *ptr)
+    {
+        Span *span = PageCache::getInstance().lookupSpan(ptr);
+        if (span == nullptr || span->pageAddr != ptr || span->isFree || span->isReleasing || span->sizeClass != 0)
+        {
+            return;
+        }
+        size_t numPages = span->numPages;
+        if (numPages > MAX_LARGE_CACHE_PAGES)
+        {
+            PageCache::getInstance().deallocatePage(ptr, numPages);
+            return;
+        }
+        Span *evicted = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            // 放入页数桶头部和LRU链表头部
+            Span *&head = buckets[numPages];
+            span->prev = nullptr;
+            span->next = head;
+            if (head)
+            {
+                head->prev = span;
+            }
+            head = span;
+            span->dirtyPrev = nullptr;
+            span->dirtyNext = lruHead;
+            if (lruHead)
+            {
+                lruHead->dirtyPrev = span;
+            }
+            else
+            {
+                lruTail = span;
+            }
+            lruHead = span;
+            cachedPages += numPages;
+            // 超出容量时淘汰最久未被复用的span
+            while (cachedPages * PAGE_SIZE > MAX_LARGE_CACHE_BYTES)
+            {
+                Span *victim = lruTail;
+                unlink(victim);
+                victim->next = evicted;
+                evicted = victim;
+            }
+        }
+        releaseSpans(evicted);
+    }
+
+    void LargeCache::flush()
+    {
+        Span *list = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            while (lruTail != nullptr)
+            {
+                Span *span = lruTail;
+                unlink(span);
+                span->next = list;
+                list = span;
+            }
+        }
+        releaseSpans(list);
+    }
+
+    void LargeCache::printStats(std::ostream &os)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        os << "LargeCache: " << cachedPages * PAGE_SIZE / 1024 << " KB cached, "
+           << hits << " hits, " << misses << " misses" << std::endl;
+    }
+
+    void LargeCache::unlink(Span *span)
+    {
+        if (span->prev)
+        {
+            span->prev->next = span->next;
+        }
+        else
+        {
+            buckets[span->numPages] = span->next;
+        }
+        if (span->next)
+        {
+            span->next->prev = span->prev;
+        }
+        if (span->dirtyPrev)
+        {
+            span->dirtyPrev->dirtyNext = span->dirtyNext;
+        }
+        else
+        {
+            lruHead = span->dirtyNext;
+        }
+        if (span->dirtyNext)
+        {
+            span->dirtyNext->dirtyPrev = span->dirtyPrev;
+        }
+        else
+        {
+            lruTail = span->dirtyPrev;
+        }
+        span->prev = span->next = nullptr;
+        span->dirtyPrev = span->dirtyNext = nullptr;
+        cachedPages -= span->numPages;
+    }
+
+    void LargeCache::releaseSpans(Span *list)
+    {
+        while (list != nullptr)
+        {
+            Span *span = list;
+            list = span->next;
+            span->next = nullptr;
+            PageCache::getInstance().deallocatePage(span->pageAddr, span->numPages);
+        }
+    }
+}
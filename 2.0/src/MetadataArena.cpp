@@ -0,0 +1,12 @@
+#include "../include/MetadataArena.h"
+#include <sys/mman.h>
+namespace Memory_Pool
+{
+    void *metadataAlloc(size_t bytes)
+    {
+        size_t size = (bytes + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+        // 匿名映射的内存已清零
+        void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+}
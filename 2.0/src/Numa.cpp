@@ -0,0 +1,120 @@
+#include "../include/Numa.h"
+#ifdef __linux__
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+namespace Memory_Pool
+{
+#ifdef __linux__
+    // mbind的策略值，与<numaif.h>一致，避免依赖libnuma的头文件
+    constexpr int MPOL_PREFERRED_MODE = 1;
+
+    // 解析sysfs中形如"0-1,3"的节点列表，返回最大节点号加1，失败返回0
+    static size_t parseNodeList(const char *path)
+    {
+        // 在分配器初始化期间调用，只使用不分配内存的系统调用
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return 0;
+        }
+        char buf[256];
+        ssize_t len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (len <= 0)
+        {
+            return 0;
+        }
+        size_t maxNode = 0;
+        bool found = false;
+        size_t value = 0;
+        bool inNumber = false;
+        for (ssize_t i = 0; i <= len; i++)
+        {
+            char c = i < len ? buf[i] : '\0';
+            if (c >= '0' && c <= '9')
+            {
+                value = value * 10 + (c - '0');
+                inNumber = true;
+                continue;
+            }
+            if (inNumber)
+            {
+                maxNode = found && maxNode > value ? maxNode : value;
+                found = true;
+            }
+            value = 0;
+            inNumber = false;
+        }
+        return found ? maxNode + 1 : 0;
+    }
+#endif
+
+    size_t numaNodeCount()
+    {
+        static const size_t count = []
+        {
+#ifdef __linux__
+            size_t nodes = parseNodeList("/sys/devices/system/node/possible");
+            if (nodes == 0)
+            {
+                return size_t(1);
+            }
+            return nodes > MAX_NUMA_NODES ? MAX_NUMA_NODES : nodes;
+#else
+            return size_t(1);
+#endif
+        }();
+        return count;
+    }
+
+    size_t currentNumaNode()
+    {
+        size_t count = numaNodeCount();
+        if (count == 1)
+        {
+            return 0;
+        }
+#ifdef __linux__
+        unsigned cpu = 0;
+        unsigned node = 0;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+        // glibc通过vDSO读取，不陷入内核
+        if (getcpu(&cpu, &node) != 0)
+        {
+            return 0;
+        }
+#else
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+        {
+            return 0;
+        }
+#endif
+        return node % count;
+#else
+        return 0;
+#endif
+    }
+
+    bool numaBind(void *addr, size_t bytes, size_t node)
+    {
+#if defined(__linux__) && defined(SYS_mbind)
+        if (numaNodeCount() == 1)
+        {
+            return true;
+        }
+        unsigned long mask[MAX_NUMA_NODES / (8 * sizeof(unsigned long)) + 1] = {};
+        mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+        // maxnode按内核约定传入掩码位数加1
+        return syscall(SYS_mbind, addr, bytes, MPOL_PREFERRED_MODE, mask,
+                       sizeof(mask) * 8 + 1, 0) == 0;
+#else
+        (void)addr;
+        (void)bytes;
+        (void)node;
+        return true;
+#endif
+    }
+}
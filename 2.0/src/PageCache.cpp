@@ -1,134 +1,792 @@
 #include "../include/PageCache.h"
+#include "../include/Numa.h"
 #include <sys/mman.h>
 #include <cstring>
+#include <ostream>
+#include <algorithm>
 namespace Memory_Pool
 {
+    static size_t roundUp(size_t n, size_t alignment)
+    {
+        return (n + alignment - 1) & ~(alignment - 1);
+    }
+
+    static char *alignUp(char *ptr, size_t alignment)
+    {
+        return reinterpret_cast<char *>(roundUp(reinterpret_cast<uintptr_t>(ptr), alignment));
+    }
+
+    // 单个span的页数上限：48位虚拟地址空间的总页数，同时保证按字节计算时不会溢出
+    static constexpr size_t MAX_SPAN_PAGES = size_t(1) << (48 - PAGE_SHIFT);
+
+    static uint64_t nowNanos()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
 
-    void *PageCache::allocatePage(size_t numPages)
+    PageCache::PageCache()
     {
-        std::lock_guard<std::mutex> lock(mtx);
+        numNodes = numaNodeCount();
+        for (size_t i = 0; i < numNodes; i++)
+        {
+            heaps[i].node = i;
+        }
+    }
+
+    Span *PageCache::allocateSpan(size_t numPages, size_t sizeClass, bool zeroed)
+    {
+        if (numPages == 0 || numPages > MAX_SPAN_PAGES)
+        {
+            return nullptr;
+        }
+        Span *span = nullptr;
+        bool dirty = false;
+        bool expired = false;
+        size_t local = currentNumaNode();
+        uint64_t now = nowNanos();
+        {
+            std::lock_guard<std::mutex> lock(heaps[local].mtx);
+            span = allocateSpanLocked(heaps[local], numPages, sizeClass, true);
+            dirty = span != nullptr && !span->isZeroed;
+            expired = hasExpired(heaps[local], now);
+        }
+        // 本节点无法再预留地址空间时，退而使用其他节点已有的空闲span
+        for (size_t i = 1; span == nullptr && i < numNodes; i++)
+        {
+            NodeHeap &heap = heaps[(local + i) % numNodes];
+            std::lock_guard<std::mutex> lock(heap.mtx);
+            span = allocateSpanLocked(heap, numPages, sizeClass, false);
+            dirty = span != nullptr && !span->isZeroed;
+        }
+        // 新映射或已归还系统的页不需要清零；脏页在锁外用memset（glibc按CPU选择向量化实现）清零
+        if (zeroed && dirty)
+        {
+            memset(span->pageAddr, 0, span->numPages * PAGE_SIZE);
+        }
+        // 只释放不分配的节点同样需要检查超时，否则空闲页要等到下一次释放才会归还
+        if (expired)
+        {
+            releaseExpired(heaps[local], now, false);
+        }
+        return span;
+    }
+
+    Span *PageCache::allocateSpanLocked(NodeHeap &heap, size_t numPages, size_t sizeClass, bool grow)
+    {
+        if (numPages == 0 || numPages > MAX_SPAN_PAGES)
+        {
+            return nullptr;
+        }
+        // 大页模式下不小于一个大页的span从2MB边界开始，空闲span需多留出对齐所需的页
+        bool huge = hugePages.load(std::memory_order_relaxed);
+        bool alignHuge = huge && numPages >= HUGE_PAGE_PAGES;
         // 查找合适的空闲span
-        // lower_bound函数返回第一个大于等于numPages的元素的迭代器
-        auto it = freeSpans.lower_bound(numPages);
-        if (it != freeSpans.end())
+        // 大页模式下已部分使用的大页剩余的空闲span比新申请的区域小，会被优先选中
+        Span *span = findFreeSpan(heap, alignHuge ? numPages + HUGE_PAGE_PAGES - 1 : numPages);
+        if (span != nullptr)
         {
-            Span *span = it->second;
-            // 将取出的span从原有的空闲链表freeSpans_[it->first]中移除
-            if (span->next)
+            // 将取出的span从空闲链表中移除
+            removeFreeSpan(heap, span);
+            if (alignHuge)
             {
-                freeSpans[it->first] = span->next;
+                // 对齐前的部分放回空闲链表，新的大页区域同样标记MADV_HUGEPAGE
+                size_t lead = (alignUp(static_cast<char *>(span->pageAddr), HUGE_PAGE_SIZE) -
+                               static_cast<char *>(span->pageAddr)) / PAGE_SIZE;
+                Span *body = lead > 0 ? splitSpan(heap, span, lead) : span;
+                if (body != span && body != nullptr)
+                {
+                    insertFreeSpan(heap, span, span->freedAt);
+                    span = body;
+                }
+#ifdef MADV_HUGEPAGE
+                madvise(span->pageAddr, numPages * PAGE_SIZE, MADV_HUGEPAGE);
+#endif
             }
-            else
+        }
+        else if (!grow)
+        {
+            return nullptr;
+        }
+        else
+        {
+            // 没有合适的span，向系统申请；大页模式按2MB整块申请，多余部分作为空闲span
+            size_t allocPages = huge ? (numPages + HUGE_PAGE_PAGES - 1) / HUGE_PAGE_PAGES * HUGE_PAGE_PAGES
+                                     : numPages;
+            // 先申请元数据，避免从预留区切出地址后因元数据不足而丢失
+            span = heap.spanArena.allocate();
+            if (span == nullptr)
             {
-                freeSpans.erase(it);
+                return nullptr;
             }
-            // 如果span大于需要的numPages则进行分割
-            if (span->numPages > numPages)
+            void *memory = systemAlloc(heap, allocPages, huge);
+            if (memory == nullptr)
             {
-                Span *newSpan = new Span;
-                newSpan->pageAddr = static_cast<char *>(span->pageAddr) +
-                                     numPages * PAGE_SIZE;
-                newSpan->numPages = span->numPages - numPages;
-                newSpan->next = nullptr;
-
-                // 将超出部分放回空闲Span*列表头部
-                auto &list = freeSpans[newSpan->numPages];
-                newSpan->next = list;
-                list = newSpan;
-
-                span->numPages = numPages;
-                // 记录新分割出的span
-                spanMap[newSpan->pageAddr] = newSpan;
+                heap.spanArena.deallocate(span);
+                return nullptr;
             }
+            span->pageAddr = memory;
+            span->node = heap.node;
+            span->numPages = allocPages;
+            // 新切出的页从未访问过，不占物理内存，分割出的剩余部分不需要再归还
+            span->releasedPages = allocPages;
+            span->isZeroed = true;
+            span->freedAt = nowNanos();
+        }
 
-            // 记录span信息用于回收
-            spanMap[span->pageAddr] = span;
-            return span->pageAddr;
+        // 如果span大于需要的numPages则进行分割，元数据耗尽时不分割，整个span交给调用方
+        Span *newSpan = span->numPages > numPages ? splitSpan(heap, span, numPages) : nullptr;
+        if (newSpan != nullptr)
+        {
+            if (alignHuge)
+            {
+                // 大页模式下剩余部分在下一个2MB边界处再分开，补齐span所在大页的小块与之后完整的大页分别管理
+                size_t tail = (alignUp(static_cast<char *>(newSpan->pageAddr), HUGE_PAGE_SIZE) -
+                               static_cast<char *>(newSpan->pageAddr)) / PAGE_SIZE;
+                Span *beyond = tail > 0 && tail < newSpan->numPages ? splitSpan(heap, newSpan, tail) : nullptr;
+                if (beyond != nullptr)
+                {
+                    insertFreeSpan(heap, beyond, beyond->freedAt);
+                }
+            }
+            // 将超出部分放回空闲链表，沿用原span的释放时间，避免分割推迟归还
+            insertFreeSpan(heap, newSpan, newSpan->freedAt);
         }
-        // 没有合适的span，向系统申请
-        void *memory = systemAlloc(numPages);
-        if (memory == nullptr)
+
+        span->sizeClass = sizeClass;
+        registerSpan(span);
+        return span;
+    }
+
+    Span *PageCache::splitSpan(NodeHeap &heap, Span *span, size_t numPages)
+    {
+        Span *newSpan = heap.spanArena.allocate();
+        if (newSpan == nullptr)
         {
             return nullptr;
         }
-        Span *span = new Span;
-        span->pageAddr = memory;
+        newSpan->pageAddr = static_cast<char *>(span->pageAddr) + numPages * PAGE_SIZE;
+        newSpan->numPages = span->numPages - numPages;
+        // 只有整体已归还的span才能确定两部分都已归还
+        bool allReleased = span->releasedPages >= span->numPages;
+        newSpan->releasedPages = allReleased ? newSpan->numPages : 0;
+        newSpan->isZeroed = span->isZeroed;
+        newSpan->node = span->node;
+        newSpan->freedAt = span->freedAt;
         span->numPages = numPages;
-        span->next = nullptr;
-
-        // 记录span信息用于回收
-        spanMap[memory] = span;
-        return memory;
+        span->releasedPages = allReleased ? numPages : std::min(span->releasedPages, numPages);
+        return newSpan;
     }
 
     void PageCache::deallocatePage(void *ptr, size_t numPages)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        // 查找对应的span，没找到代表不是PageCache分配的内存，直接返回
-        auto it = spanMap.find(ptr);
-        if (it == spanMap.end())
+        // 通过页映射查找对应的span，不是某个已分配span的起始页代表不是PageCache分配的内存，直接返回
+        Span *span = lookupSpan(ptr);
+        if (span == nullptr || span->pageAddr != ptr || span->isFree || span->isReleasing || span->numPages != numPages)
         {
             return;
         }
+        // span归还到切出它的节点页堆，而不是当前线程所在的节点
+        NodeHeap &heap = heaps[span->node];
+        uint64_t now = nowNanos();
+        bool expired = false;
+        {
+            std::lock_guard<std::mutex> lock(heap.mtx);
+            span->sizeClass = 0;
+
+            // 刚释放的页一定是脏的，只与同样是脏页的空闲span合并
+            span->releasedPages = 0;
+            span->isZeroed = false;
+            coalesce(heap, span);
+            insertFreeSpan(heap, span, now);
+            // 没有超时的span时只比较一次时间
+            expired = hasExpired(heap, now);
+        }
+
+        // 顺带归还一批空闲超时的span
+        if (expired)
+        {
+            releaseExpired(heap, now, false);
+        }
+    }
 
-        Span *span = it->second;
-        // 尝试合并相邻的span
-        void *nextAddr = static_cast<char *>(ptr) + numPages * PAGE_SIZE;
-        auto nextIt = spanMap.find(nextAddr);
+    void PageCache::coalesce(NodeHeap &heap, Span *span)
+    {
+        // 大页模式下脏页与干净页也要合并，否则同一大页内的两部分都不足一个大页，整页永远无法归还
+        bool huge = hugePages.load(std::memory_order_relaxed);
+        // 与前一个span合并：前一页是前一个span的尾页，空闲span的尾页一定已记录
+        // 每个预留区末尾留有一页不使用的间隔，相邻的span总是来自同一预留区，也就属于同一节点
+        Span *prevSpan = lookupSpan(static_cast<char *>(span->pageAddr) - PAGE_SIZE);
+        if (prevSpan == nullptr || !prevSpan->isFree || (!huge && prevSpan->isZeroed != span->isZeroed) ||
+            static_cast<char *>(prevSpan->pageAddr) + prevSpan->numPages * PAGE_SIZE != span->pageAddr)
+        {
+            prevSpan = nullptr;
+        }
+        // 与后一个span合并：后一页是后一个span的首页
+        void *nextAddr = static_cast<char *>(span->pageAddr) + span->numPages * PAGE_SIZE;
+        Span *nextSpan = lookupSpan(nextAddr);
+        if (nextSpan == nullptr || !nextSpan->isFree || (!huge && nextSpan->isZeroed != span->isZeroed) ||
+            nextSpan->pageAddr != nextAddr)
+        {
+            nextSpan = nullptr;
+        }
+        // 脏页只吸收干净邻居中与它共用大页的部分，其余仍是干净的span，不会因合并而失去确定为0的标记
+        if (prevSpan != nullptr && prevSpan->isZeroed != span->isZeroed)
+        {
+            char *cut = reinterpret_cast<char *>(reinterpret_cast<uintptr_t>(span->pageAddr) & ~(HUGE_PAGE_SIZE - 1));
+            if (cut == span->pageAddr)
+            {
+                prevSpan = nullptr;
+            }
+            else if (cut > prevSpan->pageAddr)
+            {
+                removeFreeSpan(heap, prevSpan);
+                Span *part = splitSpan(heap, prevSpan, (cut - static_cast<char *>(prevSpan->pageAddr)) / PAGE_SIZE);
+                insertFreeSpan(heap, prevSpan, prevSpan->freedAt);
+                // 元数据不足时整体合并
+                if (part != nullptr)
+                {
+                    insertFreeSpan(heap, part, part->freedAt);
+                    prevSpan = part;
+                }
+            }
+        }
+        if (nextSpan != nullptr && nextSpan->isZeroed != span->isZeroed)
+        {
+            char *cut = alignUp(static_cast<char *>(nextAddr), HUGE_PAGE_SIZE);
+            if (cut == nextAddr)
+            {
+                nextSpan = nullptr;
+            }
+            else if (cut < static_cast<char *>(nextSpan->pageAddr) + nextSpan->numPages * PAGE_SIZE)
+            {
+                removeFreeSpan(heap, nextSpan);
+                Span *rest = splitSpan(heap, nextSpan, (cut - static_cast<char *>(nextAddr)) / PAGE_SIZE);
+                if (rest != nullptr)
+                {
+                    insertFreeSpan(heap, rest, rest->freedAt);
+                }
+                insertFreeSpan(heap, nextSpan, nextSpan->freedAt);
+            }
+        }
+        if (prevSpan == nullptr && nextSpan == nullptr)
+        {
+            return;
+        }
 
-        if (nextIt != spanMap.end())
+        char *first = static_cast<char *>(prevSpan ? prevSpan->pageAddr : span->pageAddr);
+        char *last = nextSpan ? static_cast<char *>(nextSpan->pageAddr) + nextSpan->numPages * PAGE_SIZE
+                              : static_cast<char *>(span->pageAddr) + span->numPages * PAGE_SIZE;
+        bool zeroed = span->isZeroed && (!prevSpan || prevSpan->isZeroed) && (!nextSpan || nextSpan->isZeroed);
+        // 脏页与干净页合并后只记录完整大页范围内已归还的页，之后归还时按该范围计数，统计不会重复
+        // 脏span中部分归还的页本就位于它自己的完整大页内，合并后仍在范围内
+        char *rangeStart = alignUp(first, HUGE_PAGE_SIZE);
+        char *rangeEnd = reinterpret_cast<char *>(reinterpret_cast<uintptr_t>(last) & ~(HUGE_PAGE_SIZE - 1));
+        auto releasedIn = [&](Span *piece) -> size_t
+        {
+            if (zeroed || !piece->isZeroed)
+            {
+                return piece->releasedPages;
+            }
+            char *start = std::max(static_cast<char *>(piece->pageAddr), rangeStart);
+            char *end = std::min(static_cast<char *>(piece->pageAddr) + piece->numPages * PAGE_SIZE, rangeEnd);
+            return start < end ? (end - start) / PAGE_SIZE : 0;
+        };
+        size_t released = releasedIn(span);
+        size_t numPages = span->numPages;
+        for (Span *neighbor : {prevSpan, nextSpan})
         {
-            Span *nextSpan = nextIt->second;
-            // 1. 首先检查nextSpan是否在空闲链表中
-            bool found = false;
-            auto &nextList = freeSpans[nextSpan->numPages];
-            // 检查是否是头节点
-            if (nextList == nextSpan)
+            if (neighbor != nullptr)
             {
-                nextList = nextList->next;
-                found = true;
+                released += releasedIn(neighbor);
+                numPages += neighbor->numPages;
+                removeFreeSpan(heap, neighbor);
+                heap.spanArena.deallocate(neighbor);
             }
-            else if (nextList)
-            { // 只有在链表非空时才遍历
-                Span *prev = nextList;
-                while (prev->next)
+        }
+        span->pageAddr = first;
+        span->numPages = numPages;
+        span->releasedPages = released;
+        span->isZeroed = zeroed;
+    }
+
+    size_t PageCache::releaseFreeMemory()
+    {
+        size_t released = 0;
+        for (size_t i = 0; i < numNodes; i++)
+        {
+            released += releaseExpired(heaps[i], nowNanos(), true);
+        }
+        return released;
+    }
+
+    size_t PageCache::releaseExpired(NodeHeap &heap, uint64_t now, bool force)
+    {
+        struct Pending
+        {
+            Span *span;
+            char *start;
+            size_t pages;
+        };
+        size_t released = 0;
+        for (;;)
+        {
+            // 持锁取出一批超时的span，移出空闲链表后不会被分配或合并
+            Pending batch[MAX_RELEASE_BATCH];
+            size_t count = 0;
+            {
+                std::lock_guard<std::mutex> lock(heap.mtx);
+                while (count < MAX_RELEASE_BATCH && heap.dirtyHead != nullptr &&
+                       (force ? heap.dirtyHead->freedAt <= now : hasExpired(heap, now)))
                 {
-                    if (prev->next == nextSpan)
+                    Span *span = heap.dirtyHead;
+                    char *start = nullptr;
+                    size_t pages = releasableRange(span, start);
+                    if (pages <= span->releasedPages)
                     {
-                        // 将nextSpan从空闲链表中移除
-                        prev->next = nextSpan->next;
-                        found = true;
-                        break;
+                        // 入队后切换了大页模式，已没有可归还的完整大页，只移出待归还链表
+                        heap.dirtyHead = span->dirtyNext;
+                        if (heap.dirtyHead)
+                        {
+                            heap.dirtyHead->dirtyPrev = nullptr;
+                        }
+                        else
+                        {
+                            heap.dirtyTail = nullptr;
+                        }
+                        span->dirtyNext = nullptr;
+                        continue;
                     }
-                    prev = prev->next;
+                    removeFreeSpan(heap, span);
+                    span->isReleasing = true;
+                    batch[count++] = {span, start, pages};
                 }
             }
-            // 2. 只有在找到nextSpan的情况下才进行合并
-            if (found)
+            if (count == 0)
+            {
+                break;
+            }
+
+            // 保留虚拟地址映射，只释放物理页，再次访问时由内核按需提供清零的页
+            for (size_t i = 0; i < count; i++)
+            {
+                madvise(batch[i].start, batch[i].pages * PAGE_SIZE, MADV_DONTNEED);
+            }
+
+            std::lock_guard<std::mutex> lock(heap.mtx);
+            for (size_t i = 0; i < count; i++)
+            {
+                Span *span = batch[i].span;
+                released += (batch[i].pages - span->releasedPages) * PAGE_SIZE;
+                span->releasedPages = batch[i].pages;
+                // 整个span都已归还时，再次访问得到的是内核清零的页；与相邻span合并，规则同释放时
+                span->isZeroed = batch[i].pages == span->numPages;
+                span->isReleasing = false;
+                coalesce(heap, span);
+                insertFreeSpan(heap, span, span->freedAt);
+            }
+            if (!force)
+            {
+                break;
+            }
+        }
+        return released;
+    }
+
+    size_t PageCache::releasableRange(Span *span, char *&start) const
+    {
+        start = static_cast<char *>(span->pageAddr);
+        char *end = start + span->numPages * PAGE_SIZE;
+        if (hugePages.load(std::memory_order_relaxed))
+        {
+            // 大页模式只释放span内完整的2MB大页，头尾不足一个大页的部分与其他span共用大页，保持不动
+            start = alignUp(start, HUGE_PAGE_SIZE);
+            end = reinterpret_cast<char *>(reinterpret_cast<uintptr_t>(end) & ~(HUGE_PAGE_SIZE - 1));
+            if (start >= end)
             {
-                // 合并span
-                span->numPages += nextSpan->numPages;
-                spanMap.erase(nextAddr);
-                delete nextSpan;
+                return 0;
             }
         }
+        return (end - start) / PAGE_SIZE;
+    }
 
-        auto &list = freeSpans[span->numPages];
-        span->next = list;
-        list = span;
+    void PageCache::printStats(std::ostream &os)
+    {
+        for (size_t i = 0; i < numNodes; i++)
+        {
+            NodeHeap &heap = heaps[i];
+            std::lock_guard<std::mutex> lock(heap.mtx);
+            os << "PageCache";
+            if (numNodes > 1)
+            {
+                os << " (node " << i << ")";
+            }
+            os << ": " << heap.totalFreePages * PAGE_SIZE / 1024 << " KB free, "
+               << heap.totalReleasedPages * PAGE_SIZE / 1024 << " KB of it released to the OS, "
+               << heap.spanArena.inUseCount() << " spans";
+            if (hugePages.load(std::memory_order_relaxed))
+            {
+                os << ", huge pages on (" << heap.hugeRegions << " x 2MB regions)";
+            }
+            os << ", " << heap.reservedBytes / (1024 * 1024) << " MB address space reserved in "
+               << heap.reservations << " regions";
+            os << std::endl;
+        }
     }
 
-    void *PageCache::systemAlloc(size_t numPages)
+    Span *PageCache::findFreeSpan(NodeHeap &heap, size_t numPages)
+    {
+        if (numPages <= MAX_BUCKET_PAGES)
+        {
+            // 从numPages对应的位开始，找到第一个非空链表
+            size_t bucket = numPages - 1;
+            for (size_t word = bucket / 64; word < MAX_BUCKET_PAGES / 64; word++)
+            {
+                uint64_t bits = heap.smallBits[word];
+                if (word == bucket / 64)
+                {
+                    bits &= ~uint64_t(0) << (bucket % 64);
+                }
+                if (bits != 0)
+                {
+                    return heap.smallSpans[word * 64 + __builtin_ctzll(bits)];
+                }
+            }
+        }
+        // 大span按地址顺序扫描，取页数最接近的，页数相同时取地址最低的
+        Span *best = nullptr;
+        for (Span *span = heap.largeSpans; span != nullptr; span = span->next)
+        {
+            if (span->numPages >= numPages && (best == nullptr || span->numPages < best->numPages))
+            {
+                best = span;
+                if (span->numPages == numPages)
+                {
+                    break;
+                }
+            }
+        }
+        return best;
+    }
+
+    void PageCache::insertFreeSpan(NodeHeap &heap, Span *span, uint64_t freedAt)
+    {
+        span->isFree = true;
+        if (span->numPages <= MAX_BUCKET_PAGES)
+        {
+            // 插入对应页数的双向链表，默认插入头部，按地址策略下插入有序位置，并标记该链表非空
+            size_t bucket = span->numPages - 1;
+            Span *&head = heap.smallSpans[bucket];
+            if (policy.load(std::memory_order_relaxed) == SpanPolicy::AddressOrdered)
+            {
+                insertByAddress(head, span);
+            }
+            else
+            {
+                span->prev = nullptr;
+                span->next = head;
+                if (head)
+                {
+                    head->prev = span;
+                }
+                head = span;
+            }
+            heap.smallBits[bucket / 64] |= uint64_t(1) << (bucket % 64);
+        }
+        else
+        {
+            // 按地址顺序插入大span链表
+            insertByAddress(heap.largeSpans, span);
+        }
+        heap.totalFreePages += span->numPages;
+        heap.totalReleasedPages += span->releasedPages;
+        char *start = nullptr;
+        if (releasableRange(span, start) > span->releasedPages)
+        {
+            // 只有还能释放出物理页的span才加入待归还链表尾部：大页模式下只数完整的大页，
+            // 脏页与已归还的干净页合并后，只要其中还有未归还的完整大页就重新排队。
+            // 分割出的span沿用较早的释放时间，链表只是近似有序，
+            // 归还时遇到未超时的表头即停止，最多推迟一个延迟周期，不会提前归还
+            span->freedAt = freedAt;
+            span->dirtyNext = nullptr;
+            span->dirtyPrev = heap.dirtyTail;
+            if (heap.dirtyTail)
+            {
+                heap.dirtyTail->dirtyNext = span;
+            }
+            else
+            {
+                heap.dirtyHead = span;
+            }
+            heap.dirtyTail = span;
+        }
+        // 空闲span只需记录首尾页，合并时由相邻span的边界页找到它
+        registerBoundary(span);
+    }
+
+    void PageCache::insertByAddress(Span *&head, Span *span)
+    {
+        Span *prev = nullptr;
+        Span *next = head;
+        while (next != nullptr && next->pageAddr < span->pageAddr)
+        {
+            prev = next;
+            next = next->next;
+        }
+        span->prev = prev;
+        span->next = next;
+        if (prev)
+        {
+            prev->next = span;
+        }
+        else
+        {
+            head = span;
+        }
+        if (next)
+        {
+            next->prev = span;
+        }
+    }
+
+    void PageCache::sortByAddress(Span *&head)
+    {
+        // 自底向上的链表归并排序，只使用next指针，排好后再补上prev指针
+        for (size_t width = 1;; width *= 2)
+        {
+            Span *rest = head;
+            Span *sorted = nullptr;
+            Span **tail = &sorted;
+            size_t merges = 0;
+            while (rest != nullptr)
+            {
+                merges++;
+                Span *left = rest;
+                Span *right = left;
+                size_t leftSize = 0;
+                while (leftSize < width && right != nullptr)
+                {
+                    right = right->next;
+                    leftSize++;
+                }
+                size_t rightSize = width;
+                while (leftSize > 0 || (rightSize > 0 && right != nullptr))
+                {
+                    Span *pick;
+                    if (leftSize == 0 || (rightSize > 0 && right != nullptr && right->pageAddr < left->pageAddr))
+                    {
+                        pick = right;
+                        right = right->next;
+                        rightSize--;
+                    }
+                    else
+                    {
+                        pick = left;
+                        left = left->next;
+                        leftSize--;
+                    }
+                    *tail = pick;
+                    tail = &pick->next;
+                }
+                rest = right;
+            }
+            *tail = nullptr;
+            head = sorted;
+            if (merges <= 1)
+            {
+                break;
+            }
+        }
+        Span *prev = nullptr;
+        for (Span *span = head; span != nullptr; span = span->next)
+        {
+            span->prev = prev;
+            prev = span;
+        }
+    }
+
+    void PageCache::setSpanPolicy(SpanPolicy newPolicy)
+    {
+        policy.store(newPolicy, std::memory_order_relaxed);
+        if (newPolicy != SpanPolicy::AddressOrdered)
+        {
+            return;
+        }
+        // 已有的链表按默认策略插入，重新排序后表头才是地址最低的span
+        for (size_t i = 0; i < numNodes; i++)
+        {
+            std::lock_guard<std::mutex> lock(heaps[i].mtx);
+            for (Span *&head : heaps[i].smallSpans)
+            {
+                sortByAddress(head);
+            }
+        }
+    }
+
+    void PageCache::removeFreeSpan(NodeHeap &heap, Span *span)
+    {
+        span->isFree = false;
+        if (span->prev)
+        {
+            span->prev->next = span->next;
+        }
+        else if (span->numPages > MAX_BUCKET_PAGES)
+        {
+            heap.largeSpans = span->next;
+        }
+        else
+        {
+            size_t bucket = span->numPages - 1;
+            heap.smallSpans[bucket] = span->next;
+            if (span->next == nullptr)
+            {
+                // 链表已空时清除对应的位，避免分配时取到空链表
+                heap.smallBits[bucket / 64] &= ~(uint64_t(1) << (bucket % 64));
+            }
+        }
+        if (span->next)
+        {
+            span->next->prev = span->prev;
+        }
+        span->prev = span->next = nullptr;
+
+        heap.totalFreePages -= span->numPages;
+        heap.totalReleasedPages -= span->releasedPages;
+        if (isQueued(heap, span))
+        {
+            // 从待归还链表中摘除
+            if (span->dirtyPrev)
+            {
+                span->dirtyPrev->dirtyNext = span->dirtyNext;
+            }
+            else
+            {
+                heap.dirtyHead = span->dirtyNext;
+            }
+            if (span->dirtyNext)
+            {
+                span->dirtyNext->dirtyPrev = span->dirtyPrev;
+            }
+            else
+            {
+                heap.dirtyTail = span->dirtyPrev;
+            }
+            span->dirtyPrev = span->dirtyNext = nullptr;
+        }
+    }
+
+    void PageCache::registerSpan(Span *span)
+    {
+        size_t start = reinterpret_cast<uintptr_t>(span->pageAddr) >> PAGE_SHIFT;
+        for (size_t i = 0; i < span->numPages; i++)
+        {
+            pageMap.set(start + i, span);
+        }
+    }
+
+    void PageCache::registerBoundary(Span *span)
+    {
+        size_t start = reinterpret_cast<uintptr_t>(span->pageAddr) >> PAGE_SHIFT;
+        pageMap.set(start, span);
+        pageMap.set(start + span->numPages - 1, span);
+    }
+
+    void *PageCache::systemAlloc(NodeHeap &heap, size_t numPages, bool huge)
     {
         size_t size = numPages * PAGE_SIZE;
+        // 大页模式从2MB对齐的位置切分，预留区起始地址本身按2MB对齐
+        char *start = huge ? alignUp(heap.reserveCursor, HUGE_PAGE_SIZE) : heap.reserveCursor;
+        if (heap.reserveCursor == nullptr || start + size > heap.reserveEnd)
+        {
+            // 当前预留区不足，剩余部分作为未使用的空闲span保留，再预留新的区域
+            addUntouchedSpan(heap, heap.reserveCursor, heap.reserveEnd);
+            if (!reserve(heap, size))
+            {
+                return nullptr;
+            }
+            start = heap.reserveCursor;
+        }
+        // 对齐跳过的部分同样作为空闲span
+        addUntouchedSpan(heap, heap.reserveCursor, start);
+        heap.reserveCursor = start + size;
+        if (huge)
+        {
+#ifdef MADV_HUGEPAGE
+            madvise(start, size, MADV_HUGEPAGE);
+#endif
+            heap.hugeRegions += size / HUGE_PAGE_SIZE;
+        }
+        // 预留区的页在首次访问时才由内核分配并清零，不需要memset
+        return start;
+    }
 
-        // 使用mmap分配内存
-        void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-        if (ptr == MAP_FAILED)
+    bool PageCache::reserve(NodeHeap &heap, size_t minBytes)
+    {
+        // 按大页取整，使之后切分的大页区域保持对齐
+        minBytes = roundUp(minBytes, HUGE_PAGE_SIZE);
+        size_t want = roundUp(std::max(reserveSize.load(std::memory_order_relaxed), minBytes), HUGE_PAGE_SIZE);
+        for (size_t size = want; size >= minBytes; size /= 2)
         {
-            return nullptr;
+            // MAP_NORESERVE只预留地址空间，不占用提交额度；多映射一个大页用于对齐，再裁掉头尾
+            size_t mapSize = size + HUGE_PAGE_SIZE;
+            void *ptr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (ptr == MAP_FAILED)
+            {
+                continue; // 地址空间或提交额度不足时减半重试
+            }
+            char *base = static_cast<char *>(ptr);
+            char *aligned = alignUp(base, HUGE_PAGE_SIZE);
+            if (aligned > base)
+            {
+                munmap(base, aligned - base);
+            }
+            // 末尾保留一页从不切分的间隔，使不同预留区的span永远不相邻，合并时不会跨越节点
+            // 对齐后尾部至少剩一页，间隔页不访问，不占物理内存
+            char *guardEnd = aligned + size + PAGE_SIZE;
+            munmap(guardEnd, base + mapSize - guardEnd);
+            // 一次性为整个预留区创建页映射节点，之后切分时无需再检查
+            bool mapped;
+            {
+                std::lock_guard<std::mutex> lock(mapMtx);
+                mapped = pageMap.ensure(reinterpret_cast<uintptr_t>(aligned) >> PAGE_SHIFT, size / PAGE_SIZE);
+            }
+            if (!mapped)
+            {
+                munmap(aligned, size + PAGE_SIZE);
+                return false;
+            }
+            // 尚未访问的预留区绑定到所属节点，之后首次访问时物理页从该节点分配；绑定失败不影响使用
+            numaBind(aligned, size, heap.node);
+            heap.reserveCursor = aligned;
+            heap.reserveEnd = aligned + size;
+            heap.reservedBytes += size;
+            heap.reservations++;
+            // 下一次预留按几何级数增长
+            reserveSize.store(size * 2, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void PageCache::addUntouchedSpan(NodeHeap &heap, char *start, char *end)
+    {
+        if (start == nullptr || start >= end)
+        {
+            return;
+        }
+        Span *span = heap.spanArena.allocate();
+        if (span == nullptr)
+        {
+            return; // 元数据不足时放弃这段地址空间
         }
-        memset(ptr, 0, size);
-        return ptr;
+        span->pageAddr = start;
+        span->numPages = (end - start) / PAGE_SIZE;
+        span->node = heap.node;
+        // 从未访问过的页不占物理内存，内容为0
+        span->releasedPages = span->numPages;
+        span->isZeroed = true;
+        insertFreeSpan(heap, span, nowNanos());
     }
 }
@@ -0,0 +1,46 @@
+#include "../include/PageMap.h"
+#include "../include/MetadataArena.h"
+namespace Memory_Pool
+{
+    bool PageMap::ensure(size_t start, size_t numPages)
+    {
+        for (size_t pageId = start; pageId < start + numPages;)
+        {
+            size_t rootIndex = pageId >> (LEAF_BITS + NODE_BITS);
+            if (rootIndex >= ROOT_LENGTH)
+            {
+                return false; // 超出48位地址空间
+            }
+            Node *node = root[rootIndex].load(std::memory_order_relaxed);
+            if (node == nullptr)
+            {
+                node = static_cast<Node *>(allocNode(sizeof(Node)));
+                if (node == nullptr)
+                {
+                    return false;
+                }
+                // 发布前节点内容已清零，读线程通过acquire看到完整节点
+                root[rootIndex].store(node, std::memory_order_release);
+            }
+            auto &slot = node->leaves[(pageId >> LEAF_BITS) & (NODE_LENGTH - 1)];
+            if (slot.load(std::memory_order_relaxed) == nullptr)
+            {
+                Leaf *leaf = static_cast<Leaf *>(allocNode(sizeof(Leaf)));
+                if (leaf == nullptr)
+                {
+                    return false;
+                }
+                slot.store(leaf, std::memory_order_release);
+            }
+            // 跳到下一个叶子节点覆盖的第一页
+            pageId = ((pageId >> LEAF_BITS) + 1) << LEAF_BITS;
+        }
+        return true;
+    }
+
+    void *PageMap::allocNode(size_t bytes)
+    {
+        // 元数据内存已清零，原子指针的零值即为nullptr
+        return metadataAlloc(bytes);
+    }
+}
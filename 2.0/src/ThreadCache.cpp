@@ -1,146 +1,396 @@
 #include "../include/ThreadCache.h"
 #include "../include/CentralCache.h"
+#include "../include/LargeCache.h"
+#include <chrono>
+#include <mutex>
+#include <type_traits>
 namespace Memory_Pool
 {
-    void *ThreadCache::allocate(size_t size)
+    // 链表连续超过上限多少次后收缩上限
+    static const size_t MAX_OVERAGES = 3;
+
+    // 所有线程缓存组成的注册表，用于在线程间分配总预算
+    static std::mutex registryMutex;
+    static ThreadCache *registryHead = nullptr;
+    // 尚未分配给任何线程缓存的预算，预算耗尽后新线程仍领取FLOOR_THREAD_CACHE_BYTES，此时可能为负
+    // 因此所有线程缓存的总容量不超过 预算 + STEAL_AMOUNT + 线程数 * FLOOR_THREAD_CACHE_BYTES
+    static long long unclaimedCacheSpace = DEFAULT_TOTAL_THREAD_CACHE_BYTES;
+
+    ThreadCache::ThreadCache()
     {
-        if (size == 0)
+        std::lock_guard<std::mutex> lock(registryMutex);
+        // 每个线程缓存以最小容量起步，之后按需从预算中扩容；预算不足时只领取一个批次的下限
+        size_t initial = unclaimedCacheSpace >= static_cast<long long>(MIN_THREAD_CACHE_BYTES) ? MIN_THREAD_CACHE_BYTES
+                                                                                              : FLOOR_THREAD_CACHE_BYTES;
+        maxCacheSize.store(initial, std::memory_order_relaxed);
+        unclaimedCacheSpace -= initial;
+        next = registryHead;
+        if (registryHead)
         {
-            size = ALIGNMENT; // 至少分配一个对齐大小
+            registryHead->prev = this;
         }
+        registryHead = this;
+        touch();
+    }
+
+    // 缓存本身不注册析构函数，其他线程局部对象在它之后析构时仍可安全访问
+    static_assert(std::is_trivially_destructible<ThreadCache>::value, "线程缓存需可平凡析构");
+
+    ThreadCache *ThreadCache::createInstance()
+    {
+        static thread_local ThreadCache instance;
+        current = &instance;
+        // 守卫对象在instance之后构造，线程退出时负责清空缓存；比它更早构造的线程局部对象随后析构时走直通模式
+        struct Teardown
+        {
+            ~Teardown()
+            {
+                current->teardown();
+            }
+        };
+        static thread_local Teardown guard;
+        (void)guard;
+        return current;
+    }
+
+    void *ThreadCache::allocateLarge(size_t size)
+    {
+        return LargeCache::getInstance().allocate(size); // 大对象以整个span从页缓存分配
+    }
+
+    void *ThreadCache::allocateLargeZeroed(size_t size)
+    {
+        // 新映射或已归还系统的页不会重复清零
+        return LargeCache::getInstance().allocate(size, true);
+    }
+
+    void ThreadCache::deallocateLarge(void *ptr)
+    {
+        LargeCache::getInstance().deallocate(ptr);
+    }
+
+    size_t ThreadCache::allocateBatch(size_t size, size_t num, void **out)
+    {
         if (size > MAX_SIZE)
         {
-            return malloc(size); // 大对象直接从系统分配
+            for (size_t i = 0; i < num; i++)
+            {
+                if ((out[i] = allocateLarge(size)) == nullptr)
+                {
+                    return i;
+                }
+            }
+            return num;
         }
         size_t index = SizeClass::getIndex(size);
-        // 更新自由链表大小
-        free_list_size[index]--;
-        // 检查线程本地自由链表
-        // 如果 freeList_[index] 不为空，表示该链表中有可用内存块
-        if (void *ptr = free_list[index])
+        FreeList &list = free_list[index];
+        size_t count = 0;
+        // 先从线程本地自由链表中取
+        while (count < num && list.head != nullptr)
+        {
+            out[count++] = list.head;
+            list.head = *reinterpret_cast<void **>(list.head);
+        }
+        list.length -= static_cast<uint32_t>(count);
+        if (list.length < list.lowWater)
+        {
+            list.lowWater = list.length;
+        }
+        cacheSize -= count * SizeClass::classSize(index);
+
+        // 不足的部分直接向中心缓存整链获取，不经过本地链表
+        if (count < num)
         {
-            // 将freeList_[index]指向的内存块的下一个内存块地址
-            free_list[index] = *reinterpret_cast<void **>(ptr);
-            return ptr;
+            touch();
         }
-        // 如果线程本地自由链表为空，则从中心缓存获取一批内存
-        return fetchFromCentalCache(index);
+        while (count < num)
+        {
+            void *start = nullptr;
+            void *end = nullptr;
+            size_t fetchNum = CentralCache::getInstance().fetchRange(start, end, index, num - count);
+            if (fetchNum == 0)
+            {
+                break; // 中心缓存没有可用内存
+            }
+            for (void *current = start; fetchNum > 0; fetchNum--)
+            {
+                out[count++] = current;
+                current = *reinterpret_cast<void **>(current);
+            }
+        }
+        return count;
     }
 
-    void ThreadCache::deallocate(void *ptr, size_t size)
+    void ThreadCache::deallocateBatch(void **ptrs, size_t num, size_t size)
     {
+        if (num == 0)
+        {
+            return;
+        }
         if (size > MAX_SIZE)
         {
-            free(ptr);
+            for (size_t i = 0; i < num; i++)
+            {
+                deallocateLarge(ptrs[i]);
+            }
             return;
         }
         size_t index = SizeClass::getIndex(size);
-        // 将内存块添加到线程本地自由链表
-        *reinterpret_cast<void **>(ptr) = free_list[index];
-        free_list[index] = ptr;
-        // 更新自由链表大小
-        free_list_size[index]++;
-        // 判断是否需要将部分内存回收给中心缓存
-        if (shouldReturnToCentralCache(index))
+        FreeList &list = free_list[index];
+        // 本地链表能容纳的部分放入本地链表
+        size_t keepNum = list.length < list.maxLength ? std::min<size_t>(num, list.maxLength - list.length) : 0;
+        for (size_t i = 0; i < keepNum; i++)
+        {
+            *reinterpret_cast<void **>(ptrs[i]) = list.head;
+            list.head = ptrs[i];
+        }
+        list.length += static_cast<uint32_t>(keepNum);
+        cacheSize += keepNum * SizeClass::classSize(index);
+
+        // 剩余部分串成一条链表，一次性归还给中心缓存
+        if (keepNum < num)
+        {
+            touch();
+            for (size_t i = keepNum; i + 1 < num; i++)
+            {
+                *reinterpret_cast<void **>(ptrs[i]) = ptrs[i + 1];
+            }
+            *reinterpret_cast<void **>(ptrs[num - 1]) = nullptr;
+            CentralCache::getInstance().returnRange(ptrs[keepNum], ptrs[num - 1], index, num - keepNum);
+        }
+        else if (cacheSize > maxCacheSize.load(std::memory_order_relaxed))
+        {
+            scavenge();
+        }
+    }
+
+    void ThreadCache::teardown()
+    {
+        for (size_t index = 1; index < FREE_LIST_SIZE; index++)
+        {
+            // 按批次切分链表，逐批归还给中心缓存
+            while (free_list[index].length > 0)
+            {
+                returnToCentralCache(index, std::min<size_t>(free_list[index].length, SizeClass::numToMove(index)));
+            }
+            // 上限为0，之后每次释放都在listTooLong中直接归还
+            free_list[index].maxLength = 0;
+            free_list[index].lowWater = 0;
+        }
+        tornDown = true;
+
+        // 从注册表中移除，并把容量归还全局预算
+        std::lock_guard<std::mutex> lock(registryMutex);
+        unclaimedCacheSpace += maxCacheSize.exchange(0, std::memory_order_relaxed);
+        if (prev)
+        {
+            prev->next = next;
+        }
+        else
         {
-            returnToCentralCache(free_list[index], size);
+            registryHead = next;
+        }
+        if (next)
+        {
+            next->prev = prev;
         }
     }
 
-    bool ThreadCache::shouldReturnToCentralCache(size_t index)
+    void ThreadCache::setMaxTotalCacheSize(size_t bytes)
     {
-        // 设定阈值，当自由链表的大小超过一定数量时
-        size_t threshold = 64;
-        return (free_list_size[index] > threshold);
+        std::lock_guard<std::mutex> lock(registryMutex);
+        // 已分配给各线程缓存的容量保持不变，只调整未分配部分
+        long long claimed = 0;
+        for (ThreadCache *cache = registryHead; cache != nullptr; cache = cache->next)
+        {
+            claimed += cache->maxCacheSize.load(std::memory_order_relaxed);
+        }
+        unclaimedCacheSpace = static_cast<long long>(bytes) - claimed;
     }
 
     void *ThreadCache::fetchFromCentalCache(size_t index)
     {
-        size_t size = (index + 1) * ALIGNMENT;
-        // 根据对象内存大小计算批量获取的数量
-        size_t batchNum = getBatchNum(size);
+        if (MEMORY_POOL_UNLIKELY(tornDown))
+        {
+            // 线程退出期间只取需要的一块，不在本地缓存
+            void *start = nullptr;
+            void *end = nullptr;
+            return CentralCache::getInstance().fetchRange(start, end, index, 1) == 1 ? start : nullptr;
+        }
+        touch();
+        FreeList &list = free_list[index];
+        size_t batchLimit = SizeClass::numToMove(index);
+        // 慢启动：批量数不超过当前链表上限，冷门大小类每次只取少量内存块
+        size_t batchNum = std::min<size_t>(list.maxLength, batchLimit);
         // 从中心缓存获取内存块
-        void *start = CentralCache::getInstance().fetchRange(index, batchNum);
-        if (start == nullptr)
+        void *start = nullptr;
+        void *end = nullptr;
+        size_t fetchNum = CentralCache::getInstance().fetchRange(start, end, index, batchNum);
+        if (fetchNum == 0)
         {
             return nullptr; // 中心缓存没有可用内存
         }
-        free_list_size[index] += batchNum; // 更新自由链表大小
-
-        void *result = start;
         // 取一个返回，其余放入线程本地自由链表
-        if (batchNum > 1)
+        if (fetchNum > 1)
+        {
+            *reinterpret_cast<void **>(end) = list.head;
+            list.head = *reinterpret_cast<void **>(start);
+            list.length += fetchNum - 1; // 更新自由链表大小
+            cacheSize += (fetchNum - 1) * SizeClass::classSize(index);
+        }
+
+        // 每次未命中都增大链表上限：小于单批次块数时逐个增长，之后按批次增长
+        if (list.maxLength < batchLimit)
         {
-            free_list[index] = *reinterpret_cast<void **>(start);
+            list.maxLength++;
         }
-        return result; // 返回获取的内存块
+        else
+        {
+            size_t newLength = std::min(list.maxLength + batchLimit, maxListLength(index));
+            newLength -= newLength % batchLimit; // 保持为批次的整数倍
+            list.maxLength = static_cast<uint32_t>(std::max(newLength, batchLimit));
+        }
+
+        if (cacheSize > maxCacheSize.load(std::memory_order_relaxed))
+        {
+            scavenge();
+        }
+        return start; // 返回获取的内存块
     }
 
-    void ThreadCache::returnToCentralCache(void *ptr, size_t size)
+    void ThreadCache::listTooLong(size_t index)
     {
-        // 计算索引
-        size_t index = SizeClass::getIndex(size);
-        size_t batchNum = free_list_size[index];
-        if (batchNum <= 1)
+        FreeList &list = free_list[index];
+        if (MEMORY_POOL_UNLIKELY(tornDown))
         {
-            return; // 如果自由链表中只有一个元素，则不需要归还
+            // 线程退出期间的释放直接归还中心缓存
+            returnToCentralCache(index, list.length);
+            return;
         }
-        size_t keepNum = std::max(batchNum / 4, size_t(1)); // 保留1/4的内存块
-        size_t returnNum = batchNum - keepNum;              // 需要归还的内存块数量
+        touch();
+        size_t batchLimit = SizeClass::numToMove(index);
+        // 归还一个批次
+        returnToCentralCache(index, std::min<size_t>(list.length, batchLimit));
 
-        char *current = static_cast<char *>(ptr);
-        // 使用对齐后的大小计算分割点
-        char *spiltNode = current; // 指向保留链表的最后一个节点
-        for (size_t i = 0; i < keepNum - 1; i++)
+        if (list.maxLength < batchLimit)
+        {
+            // 慢启动阶段，继续增大上限
+            list.maxLength++;
+        }
+        else if (list.maxLength > batchLimit)
         {
-            spiltNode = reinterpret_cast<char *>(*reinterpret_cast<void **>(spiltNode));
-            if (spiltNode == nullptr)
+            // 频繁超过上限说明缓存过多，收缩一个批次
+            if (++list.overages > MAX_OVERAGES)
             {
-                returnNum = batchNum - (i + 1); // 如果链表提前结束，更新实际的返回数量
-                break;
+                list.maxLength -= static_cast<uint32_t>(batchLimit);
+                list.overages = 0;
             }
         }
-        if (spiltNode != nullptr)
+    }
+
+    void ThreadCache::returnToCentralCache(size_t index, size_t num)
+    {
+        FreeList &list = free_list[index];
+        void *start = list.head;
+        if (start == nullptr || num == 0)
         {
-            void *nextNode = *reinterpret_cast<void **>(spiltNode);
-            *reinterpret_cast<void **>(spiltNode) = nullptr; // 断开保留链表的最后一个节点
+            return;
+        }
+        // 找到要归还部分的最后一个节点
+        void *end = start;
+        size_t count = 1;
+        while (count < num && *reinterpret_cast<void **>(end) != nullptr)
+        {
+            end = *reinterpret_cast<void **>(end);
+            count++;
+        }
+        list.head = *reinterpret_cast<void **>(end);
+        *reinterpret_cast<void **>(end) = nullptr; // 断开归还的链表
 
-            free_list[index] = ptr; // 将剩余的内存块放入线程本地自由链表
+        // 更新自由链表大小和低水位
+        list.length -= static_cast<uint32_t>(count);
+        if (list.length < list.lowWater)
+        {
+            list.lowWater = list.length;
+        }
+        cacheSize -= count * SizeClass::classSize(index);
 
-            free_list_size[index] = keepNum; // 更新自由链表大小
+        CentralCache::getInstance().returnRange(start, end, index, count);
+    }
 
-            if (returnNum > 0 && nextNode != nullptr)
+    void ThreadCache::scavenge()
+    {
+        // 低水位表示上次回收以来一直闲置的块数，归还其中一半
+        for (size_t index = 1; index < FREE_LIST_SIZE; index++)
+        {
+            FreeList &list = free_list[index];
+            if (list.lowWater > 0)
             {
-                // 将需要归还的内存块传递给中心缓存
-                CentralCache::getInstance().returnRange(nextNode, index, returnNum);
+                size_t batchLimit = SizeClass::numToMove(index);
+                size_t dropNum = list.lowWater > 1 ? list.lowWater / 2 : 1;
+                while (dropNum > 0)
+                {
+                    size_t num = std::min(dropNum, batchLimit);
+                    returnToCentralCache(index, num);
+                    dropNum -= num;
+                }
+                // 闲置的链表同时收缩上限
+                if (list.maxLength > batchLimit)
+                {
+                    list.maxLength = static_cast<uint32_t>(std::max<size_t>(list.maxLength - batchLimit, batchLimit));
+                }
             }
+            list.lowWater = list.length;
         }
+        // 回收后仍需要更多容量，尝试扩容
+        increaseCacheLimit();
     }
 
-    size_t ThreadCache::getBatchNum(size_t size) const
-    {
-        // 基准：每次批量获取不超过4KB内存
-        constexpr size_t MAX_BATCH_SIZE = 4 * 1024;
-        // 根据对象大小设置合理的基准批量数
-        size_t baseNum;
-        if (size <= 32)
-            baseNum = 64; // 64 * 32 = 2KB
-        else if (size <= 64)
-            baseNum = 32; // 32 * 64 = 2KB
-        else if (size <= 128)
-            baseNum = 16; // 16 * 128 = 2KB
-        else if (size <= 256)
-            baseNum = 8; // 8 * 256 = 2KB
-        else if (size <= 512)
-            baseNum = 4; // 4 * 512 = 2KB
-        else if (size <= 1024)
-            baseNum = 2; // 2 * 1024 = 2KB
-        else
-            baseNum = 1; // 大于1024的对象每次只从中心缓存取1个
-        // 计算最大批量数
-        size_t maxNum = std::max(size_t(1), MAX_BATCH_SIZE / size);
+    void ThreadCache::increaseCacheLimit()
+    {
+        size_t current = maxCacheSize.load(std::memory_order_relaxed);
+        if (current >= MAX_THREAD_CACHE_BYTES)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(registryMutex);
+        if (unclaimedCacheSpace > 0)
+        {
+            // 全局预算还有剩余，直接领取
+            maxCacheSize.fetch_add(STEAL_AMOUNT, std::memory_order_relaxed);
+            unclaimedCacheSpace -= STEAL_AMOUNT;
+            return;
+        }
+        // 预算耗尽，从最久未进入慢路径的线程缓存中窃取容量
+        // 被窃取的线程在下次释放内存时发现超限，会自行回收多余的缓存
+        ThreadCache *victim = nullptr;
+        uint64_t oldest = UINT64_MAX;
+        for (ThreadCache *cache = registryHead; cache != nullptr; cache = cache->next)
+        {
+            uint64_t active = cache->lastActive.load(std::memory_order_relaxed);
+            if (cache != this && active < oldest &&
+                cache->maxCacheSize.load(std::memory_order_relaxed) >= FLOOR_THREAD_CACHE_BYTES + STEAL_AMOUNT)
+            {
+                victim = cache;
+                oldest = active;
+            }
+        }
+        if (victim)
+        {
+            victim->maxCacheSize.fetch_sub(STEAL_AMOUNT, std::memory_order_relaxed);
+            maxCacheSize.fetch_add(STEAL_AMOUNT, std::memory_order_relaxed);
+        }
+    }
+
+    void ThreadCache::touch()
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        lastActive.store(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(), std::memory_order_relaxed);
+    }
 
-        // // 取最小值，但确保至少返回1
-        return std::max(size_t(1), std::min(baseNum, maxNum));
+    size_t ThreadCache::maxListLength(size_t index)
+    {
+        size_t byteLimit = MAX_LIST_BYTES / SizeClass::classSize(index);
+        return std::max(SizeClass::numToMove(index), std::min(MAX_LIST_LENGTH, byteLimit));
     }
-}
\ No newline at end of file
+}
@@ -5,6 +5,12 @@
 #include <chrono>
 #include <iomanip>
 #include <random>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <cstring>
 using namespace std::chrono;
 using namespace Memory_Pool;
 
@@ -23,6 +29,33 @@ public:
     }
 };
 
+// 读取当前进程的常驻内存（KB）
+static size_t getRSSKB()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t totalPages = 0, residentPages = 0;
+    statm >> totalPages >> residentPages;
+    return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// 读取当前进程的常驻内存峰值（KB）
+static size_t getPeakRSSKB()
+{
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    while (status >> key)
+    {
+        if (key == "VmHWM:")
+        {
+            size_t kb = 0;
+            status >> kb;
+            return kb;
+        }
+        status.ignore(256, '\n');
+    }
+    return 0;
+}
+
 // 性能测试类
 class PerformanceTest
 {
@@ -122,6 +155,42 @@ public:
         }
     }
 
+    // 热路径测试：同一大小反复分配释放，测量单次分配+释放的耗时
+    static void testFastPath()
+    {
+        constexpr size_t NUM_PAIRS = 10000000;
+        constexpr size_t SIZE = 64;
+        std::cout << "\nTesting fast path (" << NUM_PAIRS << " alloc/free pairs of "
+                  << SIZE << " bytes):" << std::endl;
+
+        // 使用volatile大小，避免编译器把大小类计算提前
+        volatile size_t size = SIZE;
+        {
+            Timer t;
+            for (size_t i = 0; i < NUM_PAIRS; i++)
+            {
+                void *p = MemoryPool::allocate(size);
+                MemoryPool::deallocate(p, size);
+            }
+            double ms = t.elapsed();
+            std::cout << "Memory Pool: " << std::fixed << std::setprecision(3) << ms
+                      << " ms (" << ms * 1e6 / NUM_PAIRS << " ns/pair)" << std::endl;
+        }
+        {
+            Timer t;
+            for (size_t i = 0; i < NUM_PAIRS; i++)
+            {
+                char *p = new char[size];
+                // 阻止编译器消除new/delete
+                asm volatile("" : : "r"(p) : "memory");
+                delete[] p;
+            }
+            double ms = t.elapsed();
+            std::cout << "New/Delete: " << std::fixed << std::setprecision(3) << ms
+                      << " ms (" << ms * 1e6 / NUM_PAIRS << " ns/pair)" << std::endl;
+        }
+    }
+
     // 多线程测试
     static void testMultiThread()
     {
@@ -290,17 +359,373 @@ public:
                       << t.elapsed() << " ms" << std::endl;
         }
     }
+
+    // 无大小释放与带大小释放的对比测试
+    static void testSizelessDeallocate()
+    {
+        constexpr size_t NUM_ALLOCS = 100000;
+        const size_t SIZES[] = {16, 48, 128, 400, 1024, 3000};
+
+        std::cout << "\nTesting sized vs sizeless deallocation (" << NUM_ALLOCS
+                  << " allocations):" << std::endl;
+
+        std::vector<std::pair<void *, size_t>> ptrs(NUM_ALLOCS);
+        for (int round = 0; round < 2; round++)
+        {
+            bool sizeless = (round == 1);
+            for (size_t i = 0; i < NUM_ALLOCS; i++)
+            {
+                size_t size = SIZES[i % 6];
+                ptrs[i] = {MemoryPool::allocate(size), size};
+            }
+            Timer t;
+            for (const auto &[ptr, size] : ptrs)
+            {
+                if (sizeless)
+                {
+                    MemoryPool::deallocate(ptr);
+                }
+                else
+                {
+                    MemoryPool::deallocate(ptr, size);
+                }
+            }
+            std::cout << (sizeless ? "Sizeless: " : "Sized: ") << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+    }
+
+    // 批量分配释放与逐个分配释放的对比测试
+    static void testBatch()
+    {
+        constexpr size_t NUM_ROUNDS = 20000;
+        constexpr size_t BATCH = 32;
+        constexpr size_t SIZE = 96;
+
+        std::cout << "\nTesting batch allocations (" << NUM_ROUNDS << " rounds of "
+                  << BATCH << " x " << SIZE << " bytes):" << std::endl;
+
+        void *ptrs[BATCH];
+        {
+            Timer t;
+            for (size_t round = 0; round < NUM_ROUNDS; round++)
+            {
+                for (size_t i = 0; i < BATCH; i++)
+                {
+                    ptrs[i] = MemoryPool::allocate(SIZE);
+                }
+                for (size_t i = 0; i < BATCH; i++)
+                {
+                    MemoryPool::deallocate(ptrs[i], SIZE);
+                }
+            }
+            std::cout << "Per-object: " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+        {
+            Timer t;
+            for (size_t round = 0; round < NUM_ROUNDS; round++)
+            {
+                MemoryPool::allocateBatch(SIZE, BATCH, ptrs);
+                MemoryPool::deallocateBatch(ptrs, BATCH, SIZE);
+            }
+            std::cout << "Batch: " << std::fixed << std::setprecision(3)
+                      << t.elapsed() << " ms" << std::endl;
+        }
+    }
+
+    // 线程频繁创建销毁测试：线程退出时缓存应归还中心缓存，RSS保持平稳
+    static void testThreadChurn()
+    {
+        constexpr size_t NUM_ROUNDS = 50;
+        constexpr size_t NUM_THREADS = 8;
+        constexpr size_t ALLOCS_PER_THREAD = 2000;
+        static constexpr size_t SIZES[] = {16, 64, 256, 1024, 4096};
+
+        std::cout << "\nTesting thread churn (" << NUM_ROUNDS << " rounds of "
+                  << NUM_THREADS << " short-lived threads):" << std::endl;
+
+        auto threadFunc = []()
+        {
+            std::vector<std::pair<void *, size_t>> ptrs;
+            ptrs.reserve(ALLOCS_PER_THREAD);
+            for (size_t i = 0; i < ALLOCS_PER_THREAD; i++)
+            {
+                size_t size = SIZES[i % 5];
+                ptrs.emplace_back(MemoryPool::allocate(size), size);
+            }
+            for (const auto &[ptr, size] : ptrs)
+            {
+                MemoryPool::deallocate(ptr, size);
+            }
+        };
+
+        Timer t;
+        size_t firstRSS = 0;
+        for (size_t round = 0; round < NUM_ROUNDS; round++)
+        {
+            std::vector<std::thread> threads;
+            for (size_t i = 0; i < NUM_THREADS; i++)
+            {
+                threads.emplace_back(threadFunc);
+            }
+            for (auto &thread : threads)
+            {
+                thread.join();
+            }
+            if (round == 0)
+            {
+                firstRSS = getRSSKB();
+            }
+        }
+        std::cout << "Memory Pool: " << std::fixed << std::setprecision(3)
+                  << t.elapsed() << " ms, RSS after first round: " << firstRSS
+                  << " KB, after last round: " << getRSSKB() << " KB" << std::endl;
+    }
+
+    static void testOversubscribed()
+    {
+        const size_t NUM_THREADS = 4 * std::max(1u, std::thread::hardware_concurrency());
+        constexpr size_t ROUNDS = 20;
+        constexpr size_t BURST = 4096;
+        static constexpr size_t SIZES[] = {32, 128, 512};
+
+        std::cout << "\nTesting oversubscribed central cache (" << NUM_THREADS
+                  << " threads, 4x hardware threads):" << std::endl;
+
+        // 每轮突发分配后全部释放，超出线程缓存容量的部分反复经过中心缓存
+        auto threadFunc = [](size_t threadId)
+        {
+            std::vector<void *> ptrs(BURST);
+            size_t size = SIZES[threadId % 3];
+            for (size_t round = 0; round < ROUNDS; round++)
+            {
+                for (size_t i = 0; i < BURST; i++)
+                {
+                    ptrs[i] = MemoryPool::allocate(size);
+                }
+                for (size_t i = 0; i < BURST; i++)
+                {
+                    MemoryPool::deallocate(ptrs[i], size);
+                }
+            }
+        };
+
+        Timer t;
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < NUM_THREADS; i++)
+        {
+            threads.emplace_back(threadFunc, i);
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        std::cout << "Memory Pool: " << std::fixed << std::setprecision(3)
+                  << t.elapsed() << " ms" << std::endl;
+        MemoryPool::printStats(std::cout);
+    }
+
+    static void testLargeBuffers()
+    {
+        constexpr size_t NUM_OPS = 20000;
+        constexpr size_t LIVE = 16;
+
+        std::cout << "\nTesting large buffer churn (" << NUM_OPS << " buffers of 300KB-4MB, "
+                  << LIVE << " live):" << std::endl;
+
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<size_t> dist(300 * 1024, 4 * 1024 * 1024);
+        std::vector<size_t> sizes(NUM_OPS);
+        for (auto &size : sizes)
+        {
+            // 消息缓冲区大小通常集中在少数几档
+            size = dist(gen) / (256 * 1024) * (256 * 1024) + 300 * 1024;
+        }
+
+        auto run = [&](auto alloc, auto dealloc)
+        {
+            std::vector<std::pair<void *, size_t>> live(LIVE, {nullptr, 0});
+            Timer t;
+            for (size_t i = 0; i < NUM_OPS; i++)
+            {
+                auto &[ptr, size] = live[i % LIVE];
+                if (ptr != nullptr)
+                {
+                    dealloc(ptr, size);
+                }
+                size = sizes[i];
+                ptr = alloc(size);
+                static_cast<char *>(ptr)[0] = 1; // 只触碰首页，衡量分配本身的开销
+            }
+            for (auto &[ptr, size] : live)
+            {
+                dealloc(ptr, size);
+            }
+            return t.elapsed();
+        };
+
+        double poolTime = run([](size_t size) { return MemoryPool::allocate(size); },
+                              [](void *ptr, size_t size) { MemoryPool::deallocate(ptr, size); });
+        double mallocTime = run([](size_t size) { return malloc(size); },
+                                [](void *ptr, size_t) { free(ptr); });
+        std::cout << "Memory Pool: " << std::fixed << std::setprecision(3) << poolTime << " ms" << std::endl;
+        std::cout << "malloc/free: " << std::fixed << std::setprecision(3) << mallocTime << " ms" << std::endl;
+    }
+
+    static void testReleaseFreeMemory()
+    {
+        constexpr size_t NUM_THREADS = 4;
+        constexpr size_t BYTES_PER_THREAD = 64 * 1024 * 1024;
+        static constexpr size_t SIZES[] = {1024, 8192, 64 * 1024};
+
+        std::cout << "\nTesting release of idle memory after a peak ("
+                  << NUM_THREADS << " threads x " << BYTES_PER_THREAD / (1024 * 1024) << " MB):" << std::endl;
+
+        size_t baseRSS = getRSSKB();
+        // 业务高峰：短生命周期线程分配大量内存后全部释放并退出
+        auto threadFunc = []()
+        {
+            std::vector<std::pair<void *, size_t>> ptrs;
+            for (size_t total = 0, i = 0; total < BYTES_PER_THREAD; i++)
+            {
+                size_t size = SIZES[i % 3];
+                void *ptr = MemoryPool::allocate(size);
+                memset(ptr, 1, size);
+                ptrs.emplace_back(ptr, size);
+                total += size;
+            }
+            for (const auto &[ptr, size] : ptrs)
+            {
+                MemoryPool::deallocate(ptr, size);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < NUM_THREADS; i++)
+        {
+            threads.emplace_back(threadFunc);
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+        size_t idleRSS = getRSSKB();
+
+        Timer t;
+        size_t released = MemoryPool::releaseFreeMemory();
+        double releaseTime = t.elapsed();
+        std::cout << "RSS before peak: " << baseRSS << " KB, after peak: " << idleRSS
+                  << " KB, after releaseFreeMemory: " << getRSSKB() << " KB ("
+                  << released / 1024 << " KB released in " << std::fixed << std::setprecision(3)
+                  << releaseTime << " ms)" << std::endl;
+        MemoryPool::printStats(std::cout);
+    }
+
+    static void testFragmentation()
+    {
+        constexpr size_t LIVE_SPANS = 2000;
+        constexpr size_t STEPS = 400000;
+        constexpr size_t PHASE_STEPS = 50000;
+        constexpr size_t SAMPLE_STEPS = 10000;
+
+        std::cout << "\nTesting page heap fragmentation (" << LIVE_SPANS << " live spans, "
+                  << STEPS << " replacements, size mix shifts every " << PHASE_STEPS << " steps):" << std::endl;
+
+        // 每种策略在独立的子进程中运行，互不影响对方的页堆和RSS峰值
+        auto run = [](SpanPolicy policy, const char *name)
+        {
+            std::cout.flush();
+            pid_t pid = fork();
+            if (pid != 0)
+            {
+                waitpid(pid, nullptr, 0);
+                return;
+            }
+            MemoryPool::setSpanPolicy(policy);
+            // 默认10秒的延迟在本测试期间不会触发，空闲页一直驻留；缩短延迟使RSS反映碎片而不是尚未归还的页
+            MemoryPool::setReleaseDecay(std::chrono::milliseconds(10));
+            PageCache &pageCache = PageCache::getInstance();
+            std::mt19937 rng(12345);
+            // 偶数阶段以小span为主，奇数阶段混入更多大span，反复改变页数分布制造碎片
+            auto pickPages = [&rng](size_t phase) -> size_t
+            {
+                size_t r = rng() % 100;
+                if (phase % 2 == 0)
+                {
+                    return r < 90 ? 1 + rng() % 8 : 9 + rng() % 120;
+                }
+                return r < 60 ? 1 + rng() % 4 : 16 + rng() % 112;
+            };
+            auto touch = [](Span *span)
+            {
+                for (size_t i = 0; i < span->numPages; i++)
+                {
+                    static_cast<char *>(span->pageAddr)[i * PAGE_SIZE] = 1;
+                }
+            };
+
+            size_t baseRSS = getRSSKB();
+            std::vector<Span *> live(LIVE_SPANS);
+            for (auto &span : live)
+            {
+                span = pageCache.allocateSpan(pickPages(0));
+                touch(span);
+            }
+            size_t steadySum = 0;
+            size_t samples = 0;
+            Timer t;
+            for (size_t step = 0; step < STEPS; step++)
+            {
+                // 随机替换一个存活的span
+                Span *&slot = live[rng() % LIVE_SPANS];
+                pageCache.deallocatePage(slot->pageAddr, slot->numPages);
+                slot = pageCache.allocateSpan(pickPages(step / PHASE_STEPS));
+                touch(slot);
+                // 后半程的平均RSS作为稳态
+                if (step >= STEPS / 2 && step % SAMPLE_STEPS == 0)
+                {
+                    steadySum += getRSSKB();
+                    samples++;
+                }
+            }
+            double time = t.elapsed();
+            std::cout << std::left << std::setw(18) << name << std::right
+                      << "peak RSS: " << getPeakRSSKB() << " KB, steady RSS: " << steadySum / samples
+                      << " KB (start " << baseRSS << " KB), " << std::fixed << std::setprecision(3)
+                      << time << " ms" << std::endl;
+            _exit(0);
+        };
+        run(SpanPolicy::Lifo, "LIFO:");
+        run(SpanPolicy::AddressOrdered, "Address-ordered:");
+    }
 };
 
 int main()
 {
+    // 最先运行：子进程从未使用过的页堆开始，不继承其他测试留下的空闲span和驻留页
+    PerformanceTest::testFragmentation();
+
     PerformanceTest::warmup();
 
     PerformanceTest::testSmallAllocate();
 
+    PerformanceTest::testFastPath();
+
     PerformanceTest::testMultiThread();
 
     PerformanceTest::testMixSizes();
 
+    PerformanceTest::testSizelessDeallocate();
+
+    PerformanceTest::testBatch();
+
+    PerformanceTest::testThreadChurn();
+
+    PerformanceTest::testOversubscribed();
+
+    PerformanceTest::testLargeBuffers();
+
+    PerformanceTest::testReleaseFreeMemory();
+
     return 0;
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "../include/MemoryPool.h"
+#include "../include/Numa.h"
 #include <iostream>
 #include <vector>
 #include <thread>
@@ -7,6 +8,9 @@
 #include <random>
 #include <algorithm>
 #include <atomic>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace Memory_Pool;
 
@@ -124,6 +128,51 @@ void testMultiThreading()
     std::cout << "Multi-threading test passed!" << std::endl;
 }
 
+// 线程退出测试：比线程缓存更早构造的线程局部对象析构时，线程缓存已清空，释放和分配直接经过中心缓存
+struct LateReleaser
+{
+    std::vector<void *> ptrs;
+    ~LateReleaser()
+    {
+        for (void *ptr : ptrs)
+        {
+            MemoryPool::deallocate(ptr, 64);
+        }
+        void *ptr = MemoryPool::allocate(64);
+        assert(ptr != nullptr);
+        memset(ptr, 0x3C, 64);
+        MemoryPool::deallocate(ptr, 64);
+        // 更大的批量接口同样可用
+        void *batch[8];
+        size_t count = MemoryPool::allocateBatch(64, 8, batch);
+        assert(count == 8);
+        MemoryPool::deallocateBatch(batch, count, 64);
+    }
+};
+
+void testThreadExitFree()
+{
+    std::cout << "Running thread exit free test..." << std::endl;
+
+    for (int round = 0; round < 4; round++)
+    {
+        std::thread([]()
+                    {
+            // 先于线程缓存构造，因此在其之后析构
+            thread_local LateReleaser releaser;
+            releaser.ptrs.reserve(256);
+            for (size_t i = 0; i < 256; i++)
+            {
+                void *ptr = MemoryPool::allocate(64);
+                assert(ptr != nullptr);
+                releaser.ptrs.push_back(ptr);
+            } })
+            .join();
+    }
+
+    std::cout << "Thread exit free test passed!" << std::endl;
+}
+
 // 边界测试
 void testEdgeCases()
 {
@@ -153,6 +202,774 @@ void testEdgeCases()
     std::cout << "Edge cases test passed!" << std::endl;
 }
 
+// 大小类映射测试
+void testSizeClass()
+{
+    std::cout << "Running size class test..." << std::endl;
+
+    for (size_t size = 0; size <= MAX_SIZE; ++size)
+    {
+        [[maybe_unused]] size_t index = SizeClass::getIndex(size);
+        assert(index > 0 && index < FREE_LIST_SIZE);
+        // 所属大小类能容纳size，且前一个大小类不能容纳（即取到最小的合适类）
+        assert(SizeClass::classSize(index) >= size);
+        assert(index == 1 || SizeClass::classSize(index - 1) < size);
+        assert(SizeClass::classSize(index) % ALIGNMENT == 0);
+    }
+
+    std::cout << "Size class test passed! (" << FREE_LIST_SIZE - 1 << " classes)" << std::endl;
+}
+
+// 无大小释放测试
+void testSizelessDeallocate()
+{
+    std::cout << "Running sizeless deallocate test..." << std::endl;
+
+    const size_t SIZES[] = {0, 1, 8, 24, 100, 1000, 4096, 10000, 100000, MAX_SIZE, MAX_SIZE + 1};
+    std::vector<void *> ptrs;
+    for (size_t size : SIZES)
+    {
+        void *ptr = MemoryPool::allocate(size);
+        assert(ptr != nullptr);
+        if (size > 0 && size <= MAX_SIZE)
+        {
+            // 页映射查出的大小类与按大小计算的一致
+            assert(PageCache::getInstance().getSizeClass(ptr) == SizeClass::getIndex(size));
+        }
+        ptrs.push_back(ptr);
+    }
+    for (void *ptr : ptrs)
+    {
+        MemoryPool::deallocate(ptr);
+    }
+    MemoryPool::deallocate(nullptr);
+
+    // 释放后的内存块可以被同一大小类重新分配
+    void *ptr = MemoryPool::allocate(100);
+    MemoryPool::deallocate(ptr);
+    [[maybe_unused]] void *again = MemoryPool::allocate(100);
+    assert(again == ptr);
+    MemoryPool::deallocate(again, 100);
+
+    std::cout << "Sizeless deallocate test passed!" << std::endl;
+}
+
+// 批量分配释放测试
+void testBatch()
+{
+    std::cout << "Running batch allocation test..." << std::endl;
+
+    const size_t NUM = 1000;
+    std::vector<void *> ptrs(NUM);
+    for (size_t size : {size_t(64), size_t(3000), MAX_SIZE + 1})
+    {
+        [[maybe_unused]] size_t count = MemoryPool::allocateBatch(size, NUM, ptrs.data());
+        assert(count == NUM);
+        // 每个内存块都可写且互不重叠
+        for (size_t i = 0; i < NUM; ++i)
+        {
+            assert(ptrs[i] != nullptr);
+            memset(ptrs[i], static_cast<int>(i & 0xff), size);
+        }
+        for (size_t i = 0; i < NUM; ++i)
+        {
+            assert(static_cast<unsigned char *>(ptrs[i])[size - 1] == (i & 0xff));
+        }
+        MemoryPool::deallocateBatch(ptrs.data(), NUM, size);
+    }
+
+    std::cout << "Batch allocation test passed!" << std::endl;
+}
+
+// 编译期大小与类型化接口测试
+void testTypedApi()
+{
+    std::cout << "Running typed API test..." << std::endl;
+
+    struct Point
+    {
+        int x, y;
+        std::vector<int> tags;
+        Point(int x, int y) : x(x), y(y), tags{x, y} {}
+    };
+    Point *p = MemoryPool::newObject<Point>(1, 2);
+    assert(p != nullptr && p->x == 1 && p->y == 2 && p->tags.size() == 2);
+    // 与运行时接口使用同一大小类，可以混用
+    assert(PageCache::getInstance().getSizeClass(p) == SizeClass::getIndex(sizeof(Point)));
+    MemoryPool::deleteObject(p);
+    MemoryPool::deleteObject<Point>(nullptr);
+
+    void *small = MemoryPool::allocate<24>();
+    assert(small != nullptr);
+    MemoryPool::deallocate(small, 24);
+    small = MemoryPool::allocate(24);
+    MemoryPool::deallocate<24>(small);
+
+    void *large = MemoryPool::allocate<MAX_SIZE + 1>();
+    assert(large != nullptr);
+    MemoryPool::deallocate<MAX_SIZE + 1>(large);
+
+    std::cout << "Typed API test passed!" << std::endl;
+}
+
+// span回收测试：完全空闲的span归还页缓存后可被其他大小类复用
+void testSpanRelease()
+{
+    std::cout << "Running span release test..." << std::endl;
+
+    const size_t NUM = 8192;
+    std::unordered_set<uintptr_t> oldPages;
+    size_t firstNode = 0;
+    size_t secondNode = 0;
+    auto firstBurst = [&]()
+    {
+        firstNode = currentNumaNode();
+        std::vector<void *> ptrs(NUM);
+        for (size_t i = 0; i < NUM; ++i)
+        {
+            ptrs[i] = MemoryPool::allocate(2048);
+            oldPages.insert(reinterpret_cast<uintptr_t>(ptrs[i]) / PAGE_SIZE);
+        }
+        for (void *ptr : ptrs)
+        {
+            MemoryPool::deallocate(ptr, 2048);
+        }
+    };
+    std::thread(firstBurst).join();
+
+    // 线程退出后缓存归还中心缓存，其他大小类应能复用这些页
+    size_t reused = 0;
+    auto secondBurst = [&]()
+    {
+        secondNode = currentNumaNode();
+        std::vector<void *> ptrs(NUM / 2);
+        for (auto &ptr : ptrs)
+        {
+            ptr = MemoryPool::allocate(4000);
+            reused += oldPages.count(reinterpret_cast<uintptr_t>(ptr) / PAGE_SIZE);
+        }
+        for (void *ptr : ptrs)
+        {
+            MemoryPool::deallocate(ptr, 4000);
+        }
+    };
+    std::thread(secondBurst).join();
+    // 两个线程运行在不同NUMA节点时各自从本节点页堆分配，不要求复用
+    assert(reused > 0 || firstNode != secondNode);
+
+    std::cout << "Span release test passed! (" << reused << " blocks reused)" << std::endl;
+}
+
+// span页数测试：大对象类的span按预计算页数切分，对象之间互不重叠
+void testSpanPages()
+{
+    std::cout << "Running span pages test..." << std::endl;
+
+    static constexpr size_t SIZES[] = {24, 416, 3072, 40 * 1024, 200 * 1024, MAX_SIZE};
+    for (size_t size : SIZES)
+    {
+        size_t index = SizeClass::getIndex(size);
+        assert(SizeClass::objectsPerSpan(index) >= SizeClass::numToMove(index));
+        assert(SizeClass::spanWaste(index) * MAX_SPAN_WASTE_RATIO <= SizeClass::classPages(index) * PAGE_SIZE);
+
+        // 跨越多个span，写满每个对象后校验内容
+        size_t count = SizeClass::objectsPerSpan(index) * 2 + 1;
+        std::vector<unsigned char *> ptrs;
+        for (size_t i = 0; i < count; i++)
+        {
+            auto *ptr = static_cast<unsigned char *>(MemoryPool::allocate(size));
+            assert(ptr != nullptr);
+            assert(PageCache::getInstance().getSizeClass(ptr) == index);
+            memset(ptr, static_cast<int>(i & 0xFF), size);
+            ptrs.push_back(ptr);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            assert(ptrs[i][0] == (i & 0xFF) && ptrs[i][size - 1] == (i & 0xFF));
+            MemoryPool::deallocate(ptrs[i], size);
+        }
+    }
+
+    std::cout << "Span pages test passed!" << std::endl;
+}
+
+// span合并测试：释放的span与前后相邻的空闲span双向合并
+void testSpanCoalesce()
+{
+    std::cout << "Running span coalesce test..." << std::endl;
+
+    constexpr size_t PAGES = 1000;
+    PageCache &pageCache = PageCache::getInstance();
+    // 先申请并释放一块完整区域，使随后的三次申请尽量从中依次切分
+    Span *region = pageCache.allocateSpan(3 * PAGES);
+    assert(region != nullptr);
+    pageCache.deallocatePage(region->pageAddr, 3 * PAGES);
+    Span *spans[3];
+    for (auto &span : spans)
+    {
+        span = pageCache.allocateSpan(PAGES);
+        assert(span != nullptr && span->numPages == PAGES && !span->isFree);
+    }
+    std::sort(std::begin(spans), std::end(spans), [](Span *a, Span *b) { return a->pageAddr < b->pageAddr; });
+    char *first = static_cast<char *>(spans[0]->pageAddr);
+    bool adjacent = spans[1]->pageAddr == first + PAGES * PAGE_SIZE &&
+                    spans[2]->pageAddr == first + 2 * PAGES * PAGE_SIZE;
+    void *addrs[3] = {spans[0]->pageAddr, spans[1]->pageAddr, spans[2]->pageAddr};
+
+    // 先释放两端，再释放中间，中间的span应同时与前后合并
+    pageCache.deallocatePage(addrs[0], PAGES);
+    pageCache.deallocatePage(addrs[2], PAGES);
+    pageCache.deallocatePage(addrs[1], PAGES);
+    if (adjacent)
+    {
+        [[maybe_unused]] Span *merged = pageCache.lookupSpan(addrs[1]);
+        assert(merged->isFree);
+        assert(merged->pageAddr <= addrs[0]);
+        assert(static_cast<char *>(merged->pageAddr) + merged->numPages * PAGE_SIZE >= first + 3 * PAGES * PAGE_SIZE);
+        // 合并后的首尾页都能找到该span
+        assert(pageCache.lookupSpan(merged->pageAddr) == merged);
+        assert(pageCache.lookupSpan(static_cast<char *>(merged->pageAddr) + (merged->numPages - 1) * PAGE_SIZE) == merged);
+    }
+    else
+    {
+        std::cout << "Spans are not adjacent, skipped merge checks" << std::endl;
+    }
+
+    std::cout << "Span coalesce test passed!" << std::endl;
+}
+
+// span选择策略测试：按地址排序策略下，相同页数的空闲span按地址从低到高被取出
+void testSpanPolicy()
+{
+    std::cout << "Running span policy test..." << std::endl;
+
+    constexpr size_t NUM = 16;
+    constexpr size_t PAGES = 5;
+    PageCache &pageCache = PageCache::getInstance();
+    // 交替申请待释放的span和单页隔板，隔板保证释放的span之间不会合并
+    Span *spans[NUM];
+    Span *pins[NUM];
+    bool isolated = true;
+    for (size_t i = 0; i < NUM; i++)
+    {
+        spans[i] = pageCache.allocateSpan(PAGES);
+        pins[i] = pageCache.allocateSpan(1);
+        assert(spans[i] != nullptr && pins[i] != nullptr);
+        isolated = isolated && pins[i]->pageAddr == static_cast<char *>(spans[i]->pageAddr) + PAGES * PAGE_SIZE &&
+                   (i == 0 || spans[i]->pageAddr == static_cast<char *>(pins[i - 1]->pageAddr) + PAGE_SIZE);
+    }
+    void *addrs[NUM];
+    for (size_t i = 0; i < NUM; i++)
+    {
+        addrs[i] = spans[i]->pageAddr;
+    }
+    std::mt19937 rng(42);
+    auto freeShuffled = [&]()
+    {
+        std::shuffle(std::begin(addrs), std::end(addrs), rng);
+        for (void *addr : addrs)
+        {
+            pageCache.deallocatePage(addr, PAGES);
+        }
+    };
+    auto allocateAscending = [&]()
+    {
+        for (size_t i = 0; i < NUM; i++)
+        {
+            Span *span = pageCache.allocateSpan(PAGES);
+            assert(span != nullptr);
+            addrs[i] = span->pageAddr;
+            assert(!isolated || i == 0 || addrs[i] > addrs[i - 1]);
+        }
+    };
+
+    // 默认策略下乱序释放，切换策略时已有链表被重新排序
+    freeShuffled();
+    pageCache.setSpanPolicy(SpanPolicy::AddressOrdered);
+    assert(pageCache.spanPolicy() == SpanPolicy::AddressOrdered);
+    allocateAscending();
+    // 按地址策略下乱序释放，插入时即保持有序
+    freeShuffled();
+    allocateAscending();
+    pageCache.setSpanPolicy(SpanPolicy::Lifo);
+
+    for (size_t i = 0; i < NUM; i++)
+    {
+        pageCache.deallocatePage(addrs[i], PAGES);
+        pageCache.deallocatePage(pins[i]->pageAddr, 1);
+    }
+    if (!isolated)
+    {
+        std::cout << "Spans are not interleaved with pins, skipped order checks" << std::endl;
+    }
+
+    std::cout << "Span policy test passed!" << std::endl;
+}
+
+// 元数据分配器测试：对象紧密排列，释放后优先复用
+void testMetadataArena()
+{
+    std::cout << "Running metadata arena test..." << std::endl;
+
+    MetadataArena<Span> arena;
+    std::vector<Span *> spans;
+    for (size_t i = 0; i < 10000; i++)
+    {
+        Span *span = arena.allocate();
+        assert(span != nullptr && span->pageAddr == nullptr && !span->isFree);
+        assert(reinterpret_cast<uintptr_t>(span) % alignof(Span) == 0);
+        span->numPages = i;
+        spans.push_back(span);
+    }
+    assert(arena.inUseCount() == spans.size());
+    // 紧密排列：申请的总字节数不超过对象总大小加一个大块
+    assert(arena.reservedBytes() <= spans.size() * sizeof(Span) + 128 * 1024);
+    for (size_t i = 0; i < spans.size(); i++)
+    {
+        assert(spans[i]->numPages == i);
+    }
+
+    [[maybe_unused]] size_t reserved = arena.reservedBytes();
+    arena.deallocate(spans.back());
+    [[maybe_unused]] Span *reused = arena.allocate();
+    assert(reused == spans.back() && reused->numPages == 0);
+    assert(arena.reservedBytes() == reserved);
+
+    std::cout << "Metadata arena test passed!" << std::endl;
+}
+
+// 空闲页归还测试：线程退出后的空闲页可以归还系统，归还后的页仍可正常复用
+void testReleaseFreeMemory()
+{
+    std::cout << "Running release free memory test..." << std::endl;
+
+    constexpr size_t SIZE = 64 * 1024;
+    constexpr size_t COUNT = 256;
+    // 在子线程中分配和释放，线程退出时线程缓存全部归还中心缓存
+    std::thread([]()
+                {
+                    std::vector<void *> ptrs;
+                    for (size_t i = 0; i < COUNT; i++)
+                    {
+                        void *ptr = MemoryPool::allocate(SIZE);
+                        memset(ptr, 0xAB, SIZE);
+                        ptrs.push_back(ptr);
+                    }
+                    for (void *ptr : ptrs)
+                    {
+                        MemoryPool::deallocate(ptr, SIZE);
+                    } })
+        .join();
+
+    [[maybe_unused]] size_t released = MemoryPool::releaseFreeMemory();
+    assert(released >= COUNT * SIZE / 2);
+    // 没有新的空闲页时再次调用不再归还
+    [[maybe_unused]] size_t again = MemoryPool::releaseFreeMemory();
+    assert(again == 0);
+
+    // 已归还的页重新分配后可以正常读写
+    std::vector<unsigned char *> ptrs;
+    for (size_t i = 0; i < COUNT; i++)
+    {
+        auto *ptr = static_cast<unsigned char *>(MemoryPool::allocate(SIZE));
+        assert(ptr != nullptr);
+        memset(ptr, static_cast<int>(i), SIZE);
+        ptrs.push_back(ptr);
+    }
+    for (size_t i = 0; i < COUNT; i++)
+    {
+        assert(ptrs[i][0] == static_cast<unsigned char>(i) && ptrs[i][SIZE - 1] == static_cast<unsigned char>(i));
+        MemoryPool::deallocate(ptrs[i], SIZE);
+    }
+
+    std::cout << "Release free memory test passed!" << std::endl;
+}
+
+// 延迟归还测试：超时的空闲页在之后的释放或分配中归还，不需要调用releaseFreeMemory
+void testReleaseDecay()
+{
+    std::cout << "Running release decay test..." << std::endl;
+
+    PageCache &pageCache = PageCache::getInstance();
+    constexpr size_t PAGES = 64;
+    // 先清空已有的脏页和中心缓存中转的批次，之后只有本测试产生的空闲页
+    MemoryPool::releaseFreeMemory();
+
+    // 延迟为0时释放的页在本次释放中就归还
+    MemoryPool::setReleaseDecay(std::chrono::milliseconds(0));
+    Span *span = pageCache.allocateSpan(PAGES);
+    assert(span != nullptr);
+    memset(span->pageAddr, 1, PAGES * PAGE_SIZE);
+    pageCache.deallocatePage(span->pageAddr, PAGES);
+    [[maybe_unused]] size_t released = MemoryPool::releaseFreeMemory();
+    assert(released == 0);
+
+    // 超时后的第一次分配会顺带归还本节点的脏页
+    MemoryPool::setReleaseDecay(std::chrono::milliseconds(20));
+    span = pageCache.allocateSpan(PAGES);
+    assert(span != nullptr);
+    memset(span->pageAddr, 1, PAGES * PAGE_SIZE);
+    [[maybe_unused]] size_t node = span->node;
+    pageCache.deallocatePage(span->pageAddr, PAGES);
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    Span *other = pageCache.allocateSpan(1);
+    assert(other != nullptr);
+    released = MemoryPool::releaseFreeMemory();
+    // 线程迁移到其他节点时检查的是另一个页堆
+    assert(node != currentNumaNode() || released == 0);
+    pageCache.deallocatePage(other->pageAddr, 1);
+    MemoryPool::setReleaseDecay(std::chrono::seconds(10));
+
+    std::cout << "Release decay test passed!" << std::endl;
+}
+
+// 大页模式测试：新申请的区域按2MB对齐，归还时只释放完整的大页
+void testHugePages()
+{
+    std::cout << "Running huge pages test..." << std::endl;
+
+    MemoryPool::setHugePages(true);
+    PageCache &pageCache = PageCache::getInstance();
+    // 比现有空闲span都大的请求一定来自新申请的区域
+    constexpr size_t PAGES = 5000;
+    Span *span = pageCache.allocateSpan(PAGES);
+    assert(span != nullptr && span->numPages == PAGES);
+    assert(reinterpret_cast<uintptr_t>(span->pageAddr) % HUGE_PAGE_SIZE == 0);
+    memset(span->pageAddr, 1, PAGES * PAGE_SIZE);
+
+    // 区域尾部剩余的REST页作为空闲span，刚放回链表头部，相同页数的请求会取到它
+    constexpr size_t REST = HUGE_PAGE_PAGES - PAGES % HUGE_PAGE_PAGES;
+    Span *small = pageCache.allocateSpan(REST);
+    assert(small != nullptr);
+    assert(small->pageAddr == static_cast<char *>(span->pageAddr) + PAGES * PAGE_SIZE);
+
+    pageCache.deallocatePage(span->pageAddr, PAGES);
+    [[maybe_unused]] size_t released = MemoryPool::releaseFreeMemory();
+    // 只释放整块大页，区域尾部与small共用的大页保持不动
+    assert(released % HUGE_PAGE_SIZE == 0);
+    assert(released >= PAGES * PAGE_SIZE / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+    memset(small->pageAddr, 2, REST * PAGE_SIZE);
+    pageCache.deallocatePage(small->pageAddr, REST);
+    // 脏的small不足一个大页，与区域尾部未归还的部分合并后，共用的大页完整空闲，可以整体归还
+    released = MemoryPool::releaseFreeMemory();
+    assert(released >= HUGE_PAGE_SIZE);
+    MemoryPool::setHugePages(false);
+
+    std::cout << "Huge pages test passed!" << std::endl;
+}
+
+// 清零分配测试：复用的脏内存也保证为0，新映射的页不需要清零
+void testAllocateZeroed()
+{
+    std::cout << "Running zeroed allocation test..." << std::endl;
+
+    static constexpr size_t SIZES[] = {8, 100, 4096, MAX_SIZE, MAX_SIZE + 1, 4 * 1024 * 1024};
+    for (size_t size : SIZES)
+    {
+        // 先写脏再释放，使下一次分配复用同一块内存
+        void *dirty = MemoryPool::allocate(size);
+        memset(dirty, 0xCD, size);
+        MemoryPool::deallocate(dirty, size);
+        auto *ptr = static_cast<unsigned char *>(MemoryPool::allocateZeroed(size));
+        assert(ptr != nullptr);
+        for (size_t i = 0; i < size; i++)
+        {
+            assert(ptr[i] == 0);
+        }
+        MemoryPool::deallocate(ptr, size);
+    }
+
+    // 页缓存跟踪span是否确定为0：脏span清零后分配，新映射的span无需清零
+    PageCache &pageCache = PageCache::getInstance();
+    Span *span = pageCache.allocateSpan(300);
+    assert(span != nullptr);
+    void *addr = span->pageAddr;
+    memset(addr, 0xEF, 300 * PAGE_SIZE);
+    pageCache.deallocatePage(addr, 300);
+    assert(!pageCache.lookupSpan(addr)->isZeroed);
+    span = pageCache.allocateSpan(300, 0, true);
+    [[maybe_unused]] auto *bytes = static_cast<unsigned char *>(span->pageAddr);
+    for (size_t i = 0; i < 300 * PAGE_SIZE; i += 512)
+    {
+        assert(bytes[i] == 0);
+    }
+    pageCache.deallocatePage(span->pageAddr, 300);
+    // 比现有空闲span都大的请求来自新映射，内容确定为0
+    Span *fresh = pageCache.allocateSpan(20000, 0, true);
+    assert(fresh != nullptr && fresh->isZeroed);
+    pageCache.deallocatePage(fresh->pageAddr, 20000);
+    // 所有空闲span整体归还系统后内容确定为0，再次分配时不需要清零
+    MemoryPool::releaseFreeMemory();
+    span = pageCache.allocateSpan(300, 0, true);
+    assert(span->isZeroed);
+    pageCache.deallocatePage(span->pageAddr, 300);
+
+    // 释放的脏span不与干净的相邻span合并，干净部分保持已归还和为0的状态
+    MemoryPool::releaseFreeMemory();
+    span = pageCache.allocateSpan(3);
+    assert(span != nullptr);
+    addr = span->pageAddr;
+    pageCache.deallocatePage(addr, 3);
+    [[maybe_unused]] Span *freed = pageCache.lookupSpan(addr);
+    // 大页模式下只部分归还的脏span仍可能与之合并
+    assert(freed->isFree && !freed->isZeroed && freed->releasedPages < freed->numPages);
+    Span *rest = pageCache.lookupSpan(static_cast<char *>(addr) + 3 * PAGE_SIZE);
+    bool hasRest = rest != nullptr && rest->isFree && rest->pageAddr == static_cast<char *>(addr) + 3 * PAGE_SIZE;
+    if (hasRest)
+    {
+        assert(rest->isZeroed && rest->releasedPages == rest->numPages);
+    }
+    // 归还后两者都是干净的span，重新合并
+    MemoryPool::releaseFreeMemory();
+    freed = pageCache.lookupSpan(addr);
+    assert(freed->isFree && freed->isZeroed && freed->releasedPages == freed->numPages);
+    assert(!hasRest || freed->numPages > 3);
+
+    std::cout << "Zeroed allocation test passed!" << std::endl;
+}
+
+// 大对象测试：大对象来自页缓存的span，释放后按页数缓存复用，无大小释放同样适用
+void testLargeObjects()
+{
+    std::cout << "Running large object test..." << std::endl;
+
+    constexpr size_t SIZE = 300 * 1024;
+    void *ptr = MemoryPool::allocate(SIZE);
+    assert(ptr != nullptr);
+    [[maybe_unused]] Span *span = PageCache::getInstance().lookupSpan(ptr);
+    assert(span != nullptr && span->pageAddr == ptr && span->sizeClass == 0);
+    assert(span->numPages == (SIZE + PAGE_SIZE - 1) / PAGE_SIZE);
+    memset(ptr, 0x5A, SIZE);
+    MemoryPool::deallocate(ptr, SIZE);
+
+    // 相同页数的请求直接复用刚释放的span
+    void *again = MemoryPool::allocate(SIZE - 100);
+    assert(again == ptr);
+    MemoryPool::deallocate(again);
+
+    // 超出缓存上限的大对象直接归还页缓存
+    constexpr size_t HUGE_SIZE = (MAX_LARGE_CACHE_PAGES + 1) * PAGE_SIZE;
+    auto *huge = static_cast<char *>(MemoryPool::allocate(HUGE_SIZE));
+    assert(huge != nullptr);
+    huge[0] = huge[HUGE_SIZE - 1] = 1;
+    MemoryPool::deallocate(huge);
+    assert(PageCache::getInstance().lookupSpan(huge)->isFree);
+
+    // 多线程下不同大小的大对象交替分配释放
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++)
+    {
+        threads.emplace_back([t]()
+                             {
+                                 std::mt19937 gen(static_cast<unsigned>(t));
+                                 std::uniform_int_distribution<size_t> dist(MAX_SIZE + 1, 4 * 1024 * 1024);
+                                 std::vector<std::pair<char *, size_t>> ptrs;
+                                 for (size_t i = 0; i < 200; i++)
+                                 {
+                                     size_t size = dist(gen);
+                                     auto *p = static_cast<char *>(MemoryPool::allocate(size));
+                                     assert(p != nullptr);
+                                     p[0] = p[size - 1] = static_cast<char>(i);
+                                     ptrs.emplace_back(p, size);
+                                     if (ptrs.size() > 8)
+                                     {
+                                         auto [old, oldSize] = ptrs.front();
+                                         assert(old[oldSize - 1] == old[0]);
+                                         MemoryPool::deallocate(old, oldSize);
+                                         ptrs.erase(ptrs.begin());
+                                     }
+                                 }
+                                 for (auto [p, size] : ptrs)
+                                 {
+                                     MemoryPool::deallocate(p);
+                                 } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    // 按页取整会溢出或超出地址空间的请求返回nullptr，不会得到0页的span
+    for (size_t size : {SIZE_MAX, SIZE_MAX - 100, SIZE_MAX / 2})
+    {
+        [[maybe_unused]] void *tooLarge = MemoryPool::allocate(size);
+        assert(tooLarge == nullptr);
+    }
+    [[maybe_unused]] void *tooLargeZeroed = MemoryPool::allocateZeroed(SIZE_MAX);
+    assert(tooLargeZeroed == nullptr);
+    [[maybe_unused]] Span *empty = PageCache::getInstance().allocateSpan(0);
+    assert(empty == nullptr);
+
+    std::cout << "Large object test passed!" << std::endl;
+}
+
+// 当前进程的内存映射数
+static size_t countMappings()
+{
+    // 直接读取文件，不经过会分配内存的流和字符串，避免统计本身新增映射（如ASan按大小类创建的区域）
+    int fd = open("/proc/self/maps", O_RDONLY);
+    assert(fd >= 0);
+    char buf[4096];
+    size_t count = 0;
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+    {
+        count += std::count(buf, buf + len, '\n');
+    }
+    close(fd);
+    return count;
+}
+
+// 地址空间预留测试：页缓存未命中时从预留区切分，不会为每个span新建映射
+void testAddressReservation()
+{
+    std::cout << "Running address reservation test..." << std::endl;
+
+    PageCache &pageCache = PageCache::getInstance();
+    // 先分配好记录用的数组，避免其扩容本身新增映射
+    std::vector<Span *> spans;
+    spans.reserve(2000);
+    [[maybe_unused]] size_t before = countMappings();
+    for (size_t i = 0; i < 2000; i++)
+    {
+        Span *span = pageCache.allocateSpan(8 + i % 3);
+        assert(span != nullptr);
+        // 触碰每个span的首页，确认预留区的页可以直接使用
+        *static_cast<char *>(span->pageAddr) = 1;
+        spans.push_back(span);
+    }
+    // 元数据分配器和页映射节点可能新增少量映射
+    assert(countMappings() <= before + 8);
+    for (Span *span : spans)
+    {
+        pageCache.deallocatePage(span->pageAddr, span->numPages);
+    }
+
+    std::cout << "Address reservation test passed!" << std::endl;
+}
+
+void testNumaNodes()
+{
+    std::cout << "Running NUMA node test..." << std::endl;
+
+    PageCache &pageCache = PageCache::getInstance();
+    size_t nodes = numaNodeCount();
+    assert(nodes >= 1 && nodes <= MAX_NUMA_NODES);
+    assert(pageCache.nodeCount() == nodes);
+
+    // 各线程从所在节点的页堆分配，由主线程统一释放，span应回到切出它的节点
+    const size_t NUM_THREADS = 4;
+    std::vector<Span *> spans(NUM_THREADS);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < NUM_THREADS; i++)
+    {
+        threads.emplace_back([&spans, i, nodes]()
+                             {
+            assert(currentNumaNode() < nodes);
+            spans[i] = PageCache::getInstance().allocateSpan(16);
+            assert(spans[i] != nullptr && spans[i]->node < nodes); });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    for (Span *span : spans)
+    {
+        [[maybe_unused]] size_t node = span->node;
+        void *addr = span->pageAddr;
+        pageCache.deallocatePage(addr, 16);
+        // 刚释放的页仍指向合并后的span，合并不会跨越节点
+        [[maybe_unused]] Span *freeSpan = pageCache.lookupSpan(addr);
+        assert(freeSpan != nullptr && freeSpan->isFree && freeSpan->node == node);
+    }
+    if (nodes == 1)
+    {
+        // 单节点机器退化为一个页堆
+        assert(currentNumaNode() == 0);
+    }
+
+    std::cout << "NUMA node test passed!" << std::endl;
+}
+
+// 空闲span链表测试：刚释放的span位于对应页数链表的表头，再次申请相同页数时直接取回
+void testFreeSpanBuckets()
+{
+    std::cout << "Running free span bucket test..." << std::endl;
+
+    PageCache &pageCache = PageCache::getInstance();
+    // 覆盖位图的字边界和页数链表的上限
+    const size_t sizes[] = {1, 2, 63, 64, 65, 100, 127, 128};
+    size_t checked = 0;
+    for (size_t pages : sizes)
+    {
+        Span *span = pageCache.allocateSpan(pages);
+        assert(span != nullptr && span->numPages == pages);
+        void *addr = span->pageAddr;
+        pageCache.deallocatePage(addr, pages);
+        // 释放后可能与相邻空闲span合并，刚释放的页指向合并后的span
+        Span *freeSpan = pageCache.lookupSpan(addr);
+        assert(freeSpan != nullptr && freeSpan->isFree && freeSpan->numPages >= pages);
+        size_t merged = freeSpan->numPages;
+        [[maybe_unused]] void *mergedAddr = freeSpan->pageAddr;
+        Span *again = pageCache.allocateSpan(merged);
+        assert(again != nullptr && again->numPages == merged);
+        if (merged <= MAX_BUCKET_PAGES)
+        {
+            assert(again->pageAddr == mergedAddr);
+            checked++;
+        }
+        pageCache.deallocatePage(again->pageAddr, merged);
+    }
+    assert(checked > 0);
+
+    // 超过页数链表上限的span同样能被找到并按需分割
+    Span *large = pageCache.allocateSpan(MAX_BUCKET_PAGES * 3);
+    assert(large != nullptr);
+    pageCache.deallocatePage(large->pageAddr, MAX_BUCKET_PAGES * 3);
+    Span *part = pageCache.allocateSpan(MAX_BUCKET_PAGES + 1);
+    assert(part != nullptr && part->numPages == MAX_BUCKET_PAGES + 1);
+    pageCache.deallocatePage(part->pageAddr, part->numPages);
+
+    std::cout << "Free span bucket test passed! (" << checked << " exact reuses)" << std::endl;
+}
+
+#ifdef MEMORY_POOL_PER_CPU_CACHE
+// 每CPU缓存测试：释放分散在许多大小类中时，每个CPU槽仍不超过字节上限
+void testCpuCache()
+{
+    std::cout << "Running per-CPU cache test..." << std::endl;
+    if (!CpuCache::isAvailable())
+    {
+        std::cout << "rseq unavailable, per-CPU cache test skipped" << std::endl;
+        return;
+    }
+
+    // 每个大小类各释放两个批次，单个链表不超限，总量远超槽的上限
+    std::vector<std::pair<void *, size_t>> ptrs;
+    for (size_t index = 1; index < FREE_LIST_SIZE; index++)
+    {
+        size_t size = SizeClass::classSize(index);
+        for (size_t i = 0; i < 2 * SizeClass::numToMove(index); i++)
+        {
+            void *ptr = MemoryPool::allocate(size);
+            assert(ptr != nullptr);
+            ptrs.emplace_back(ptr, size);
+        }
+    }
+    for (auto &[ptr, size] : ptrs)
+    {
+        MemoryPool::deallocate(ptr, size);
+    }
+    CpuCache &cpuCache = CpuCache::getInstance();
+    for (size_t cpu = 0; cpu < cpuCache.slotCount(); cpu++)
+    {
+        assert(cpuCache.cachedBytes(cpu) <= MAX_CPU_CACHE_BYTES);
+    }
+
+    std::cout << "Per-CPU cache test passed!" << std::endl;
+}
+#endif
+
 // 压力测试
 void testStress()
 {
@@ -188,10 +1005,32 @@ int main()
     {
         std::cout << "Starting memory pool tests..." << std::endl;
 
+        // 在其他测试产生空闲span之前运行，保证切分出的span相邻
+        testSpanCoalesce();
+        testSpanPolicy();
         testBasicAllocation();
         testMemoryWriting();
         testMultiThreading();
+        testThreadExitFree();
         testEdgeCases();
+        testSizeClass();
+        testSizelessDeallocate();
+        testBatch();
+        testTypedApi();
+        testSpanRelease();
+        testSpanPages();
+        testMetadataArena();
+        testReleaseFreeMemory();
+        testReleaseDecay();
+        testHugePages();
+        testAllocateZeroed();
+        testLargeObjects();
+        testAddressReservation();
+        testNumaNodes();
+        testFreeSpanBuckets();
+#ifdef MEMORY_POOL_PER_CPU_CACHE
+        testCpuCache();
+#endif
         testStress();
 
         std::cout << "All tests passed successfully!" << std::endl